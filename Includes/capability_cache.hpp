@@ -0,0 +1,77 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace networking
+{
+	// Capabilities a server may list in its FEAT reply (RFC 2389), and
+	// whether it answers FEAT at all; one bit each
+	enum class ftp_capability : std::uint32_t
+	{
+		FEAT = 1u << 0,
+		MLSD = 1u << 1,
+		EPSV = 1u << 2,
+		MODE_Z = 1u << 3,
+		MODE_B = 1u << 4,
+		REST_STREAM = 1u << 5,
+		SIZE = 1u << 6,
+		MDTM = 1u << 7,
+		HASH = 1u << 8,
+		UTF8 = 1u << 9
+	};
+
+	// Set of the capabilities of a server
+	class capability_set
+	{
+	public:
+		capability_set() = default;
+		explicit capability_set( std::uint32_t flags ) noexcept;
+
+		bool has( ftp_capability capability ) const noexcept;
+		bool lacks( ftp_capability capability ) const noexcept;
+		void add( ftp_capability capability ) noexcept;
+		std::uint32_t get_flags() const noexcept;
+
+	private:
+		std::uint32_t flags = 0;
+	};
+
+	// Class keeping the capabilities of the servers connected to in a file,
+	// so that later sessions need not query them. A server is known by its
+	// host, its port and its banner, the text of its greeting, so that an
+	// upgraded server, which usually announces another version, is queried
+	// again; servers sharing a host on different ports are kept apart.
+	// The file holds one line per server: the host, the port, a hash of the
+	// banner and the capabilities, in hexadecimal.
+	class capability_cache
+	{
+	public:
+		// Name of the file in the home directory of the user
+		static constexpr char const * FILENAME = ".ftp-capabilities";
+
+		static std::string get_default_path();
+
+		explicit capability_cache( std::string path );
+
+		bool find(
+			std::string const & host,
+			std::uint16_t port,
+			std::string const & banner,
+			capability_set& capabilities ) const;
+		bool store(
+			std::string const & host,
+			std::uint16_t port,
+			std::string const & banner,
+			capability_set capabilities ) const;
+
+	private:
+		// Path of the file, or empty if capabilities are not kept
+		std::string path;
+	};
+}
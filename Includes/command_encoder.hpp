@@ -0,0 +1,89 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace networking
+{
+	// Commands sent on the command connection, in alphabetical order
+	enum class ftp_verb : std::uint8_t
+	{
+		ABOR,
+		APPE,
+		CDUP,
+		CWD,
+		DELE,
+		EPSV,
+		FEAT,
+		LIST,
+		MDTM,
+		MKD,
+		MLSD,
+		MODE,
+		NLST,
+		NOOP,
+		PASS,
+		PASV,
+		PWD,
+		QUIT,
+		REIN,
+		REST,
+		RETR,
+		RMD,
+		SIZE,
+		STAT,
+		STOR,
+		STOU,
+		SYST,
+		TYPE,
+		USER
+	};
+
+	// Text of the commands, in the order of ftp_verb
+	static constexpr std::array< std::string_view, static_cast< std::size_t >( ftp_verb::USER ) + 1 > FTP_VERBS
+	{ {
+		"ABOR", "APPE", "CDUP", "CWD", "DELE", "EPSV", "FEAT", "LIST", "MDTM", "MKD",
+		"MLSD", "MODE", "NLST", "NOOP", "PASS", "PASV", "PWD", "QUIT", "REIN", "REST",
+		"RETR", "RMD", "SIZE", "STAT", "STOR", "STOU", "SYST", "TYPE", "USER"
+	} };
+
+	constexpr std::string_view
+	to_string( ftp_verb verb ) noexcept
+	{
+		return FTP_VERBS[static_cast< std::size_t >( verb )];
+	}
+
+	// Class writing command lines, "VERB SP argument CRLF" (RFC 959,
+	// section 5.3), into a buffer of its own, reused from one command to the
+	// next; nothing is allocated. Several lines may be written before the
+	// buffer is sent, as when pipelining.
+	class command_encoder
+	{
+	public:
+		// Room for a command with the longest path name, and then some
+		static constexpr std::size_t CAPACITY = 8 * 1024;
+
+		bool append(
+			ftp_verb verb,
+			std::string_view argument = {} ) noexcept;
+		bool append(
+			std::string_view verb,
+			std::string_view argument = {} ) noexcept;
+		void clear() noexcept;
+
+		char const * data() const noexcept;
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+	private:
+		std::array< char, CAPACITY > buffer;
+		std::size_t length = 0;
+	};
+}
@@ -0,0 +1,72 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace networking
+{
+	// Class compressing or decompressing the data of a transfer in
+	// compressed mode (MODE Z), as one deflate stream in the zlib format
+	// (RFC 1950), a buffer at a time.
+	// While compressing, the level follows how well the data compresses:
+	// data that barely shrinks, such as archives or media, is compressed
+	// faster and eventually only stored, and tried again now and then.
+	class deflate_stream
+	{
+	public:
+		// Level of data that compresses well
+		static constexpr int DEFAULT_LEVEL = 6;
+		// Level of data that compresses poorly
+		static constexpr int FAST_LEVEL = 1;
+		// Input compressed between changes of level
+		static constexpr std::size_t LEVEL_WINDOW = 1024 * 1024;
+
+		explicit deflate_stream( bool compressing );
+		~deflate_stream() noexcept;
+
+		// The zlib state refers back to the stream, which may not move
+		deflate_stream( deflate_stream const & ) = delete;
+		deflate_stream& operator=( deflate_stream const & ) = delete;
+
+		bool is_valid() const noexcept;
+		bool reset() noexcept;
+
+		void set_input(
+			void const * data,
+			std::size_t size ) noexcept;
+		bool has_input() const noexcept;
+		int compress(
+			void* output,
+			std::size_t output_size,
+			bool finish ) noexcept;
+		int decompress(
+			void* output,
+			std::size_t output_size ) noexcept;
+		bool is_finished() const noexcept;
+		int get_level() const noexcept;
+
+	private:
+		void adapt_level() noexcept;
+
+		z_stream stream {};
+		bool compressing;
+		bool valid = false;
+		// Whether the end of the stream was produced or reached
+		bool finished = false;
+		// Level in use, and the level to switch to
+		int level = DEFAULT_LEVEL;
+		int next_level = DEFAULT_LEVEL;
+		// Bytes in and out since the last change of level
+		std::uint64_t window_input = 0;
+		std::uint64_t window_output = 0;
+		// Windows stored since compression was last tried
+		unsigned stored_windows = 0;
+	};
+}
@@ -0,0 +1,33 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#ifdef __linux__
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+#elif _WIN32
+	#include <WinSock2.h>
+	#include <WS2tcpip.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace networking
+{
+	// Address and port of a TCP peer, either IPv4 or IPv6
+	struct endpoint
+	{
+		sockaddr_storage address {};
+		int address_length = 0;
+
+		bool is_valid() const noexcept;
+		int get_family() const noexcept;
+		std::uint16_t get_port() const noexcept;
+		void set_port( std::uint16_t port ) noexcept;
+		std::string to_string() const;
+	};
+}
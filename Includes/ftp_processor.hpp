@@ -3,9 +3,23 @@
  * MIT License (MIT), http://opensource.org/licenses/MIT
  */
 
+#pragma once
+
+#include "capability_cache.hpp"
+#include "command_encoder.hpp"
+#include "deflate_stream.hpp"
+#include "reactor.hpp"
+#include "reply_parser.hpp"
+#include "resolver.hpp"
 #include "socket.hpp"
+#include "socket_pool.hpp"
+#include "transfer_engine.hpp"
 
 #include <array>
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <memory>
 
 /*
 	 Access Control Commands
@@ -50,20 +64,51 @@
 
 namespace networking
 {
+	// File listed in a directory of the server
+	struct remote_file
+	{
+		std::string name;
+		// Size in bytes, or -1 if unknown
+		std::int64_t size = -1;
+	};
+
+	// Command sent in a pipeline, and the final reply the server gave to it
+	struct pipelined_command
+	{
+		std::string command;
+		std::string parameter;
+		// Reply code, or 0 if no reply was received
+		int reply_code = 0;
+		std::string reply;
+
+		bool succeeded() const noexcept;
+	};
+
 	// Class implementing an FTP client operating in passive mode.
 	// It connects two sockets to the FTP server; one for commands
 	// and one for data.
 	class ftp_processor
 	{
 	public:
-		ftp_processor() = default;
+		// Commands sent ahead of their replies by default
+		static constexpr std::size_t DEFAULT_PIPELINE_WINDOW = 16;
+
+		// Function called with each reply received
+		using reply_handler = std::function< void( reply_view const & reply ) >;
+		// Function called with the data of directory listings
+		using listing_handler = std::function< void( std::string_view data ) >;
+		// Function called when a transfer driven by a reactor ends
+		using completion_handler = std::function< void( bool succeeded ) >;
+
+		ftp_processor();
 		virtual ~ftp_processor() noexcept;
 
+		// A moved-from processor may only be destroyed or assigned to
 		ftp_processor( ftp_processor const & ) = delete;
-		ftp_processor( ftp_processor&& ) noexcept = delete;
+		ftp_processor( ftp_processor&& ) noexcept = default;
 
 		ftp_processor& operator=( ftp_processor const & ) = delete;
-		ftp_processor& operator=( ftp_processor&& ) noexcept = delete;
+		ftp_processor& operator=( ftp_processor&& ) noexcept = default;
 
 		// Connection
 		bool is_connected() const noexcept;
@@ -71,55 +116,341 @@ namespace networking
 		bool connect(
 			std::string const & host_address,
 			std::uint16_t port = 0 );
+		bool connect_session(
+			ftp_processor const & origin,
+			std::string const & directory = "" );
 		void disconnect( bool full );
 
 		// Commands
-		bool ftp_command(
-			const std::string command,
-			const std::string parameter );
+		reply_view ftp_command(
+			std::string_view command,
+			std::string_view parameter );
+		reply_view ftp_command(
+			ftp_verb command,
+			std::string_view parameter = {} );
+		reply_view ftp_command(
+			ftp_verb command,
+			std::int64_t parameter );
+		reply_view get_reply() const noexcept;
+		void set_reply_handler( reply_handler handler );
+		void set_listing_handler( listing_handler handler );
+		bool pipeline_commands(
+			std::vector< pipelined_command >& commands,
+			std::size_t window = DEFAULT_PIPELINE_WINDOW );
+		bool delete_files(
+			std::vector< std::string > const & filenames,
+			std::vector< std::string >& failed_filenames );
 		void terminate();
 		bool set_transfer_type( bool type );
+		bool get_transfer_type() const noexcept;
 		bool send_user_name( std::string const & name );
 		bool send_user_password( std::string const & password );
-		bool show_os();
+		bool login(
+			std::string const & name,
+			std::string const & password,
+			std::string const & directory = "" );
+		void set_fast_login( bool fast_login ) noexcept;
+		bool is_fast_login() const noexcept;
+		reply_view show_os();
 		bool list_directories();
 		bool list_directory_name();
-		bool get_directory();
-		bool set_directory( std::string const & directory );
-		bool set_directory_to_parent();
-		bool remove_directory( std::string const & directory );
-		bool make_directory( std::string const & directory );
-		bool reinitialize();
-		bool status();
-		bool delete_file( std::string const & filename );
+		reply_view get_directory();
+		reply_view set_directory( std::string const & directory );
+		reply_view set_directory_to_parent();
+		reply_view remove_directory( std::string const & directory );
+		reply_view make_directory( std::string const & directory );
+		reply_view reinitialize();
+		reply_view status();
+		reply_view delete_file( std::string const & filename );
 		bool get_file( std::string const & filename );
+		bool get_file(
+			std::string const & filename,
+			std::string const & local_filename );
 		bool put_file( std::string const & filename );
+		bool put_data(
+			std::string const & filename,
+			void const * data,
+			std::size_t size );
+		bool get_file_segmented(
+			std::string const & filename,
+			std::size_t session_count );
+		bool put_file_segmented(
+			std::string const & filename,
+			std::size_t session_count );
+		bool get_working_directory( std::string& directory );
+		std::int64_t get_file_size( std::string const & filename );
+		bool get_modification_time(
+			std::string const & filename,
+			std::chrono::system_clock::time_point& time );
+		bool get_status(
+			std::vector< std::string >& lines,
+			std::string const & path = "" );
+		bool has_feature( std::string const & feature );
+		bool get_features( std::vector< std::string >& features );
+		bool has_capability( ftp_capability capability );
+		void set_capability_cache( std::string const & path );
+		bool list_files(
+			std::string const & directory,
+			std::vector< remote_file >& files );
+
+		// Transfers driven by the caller
+		bool open_download(
+			std::string const & filename,
+			std::int64_t offset );
+		bool open_upload(
+			std::string const & filename,
+			std::int64_t offset,
+			bool append );
+		int receive_data(
+			void* buffer,
+			std::size_t buffer_size );
+		int send_data(
+			void const * buffer,
+			std::size_t buffer_size );
+		bool close_transfer( bool cut_short = false );
+
+		// Cancellation of the open transfer
+		bool abort_transfer();
+		bool cancel_transfer() noexcept;
+
+		// Block mode keeps one data connection for many transfers
+		bool set_block_mode( bool block_mode );
+		bool is_block_mode() const noexcept;
+
+		// Compressed mode deflates the data of transfers
+		bool set_compressed_mode( bool compressed_mode );
+		bool is_compressed_mode() const noexcept;
+
+		// Stream mode transfers prepare the data connection of the next one
+		void set_pasv_prefetch( bool prefetch ) noexcept;
+		bool is_pasv_prefetch() const noexcept;
+
+		// Interrupted binary transfers resume from a checkpoint
+		void set_resumable( bool resumable ) noexcept;
+		bool is_resumable() const noexcept;
+
+		// Sessions attached to a reactor share its thread: their replies are
+		// parsed, and their started transfers move, as their sockets are ready
+		bool attach( reactor& events );
+		void detach();
+		bool is_attached() const noexcept;
+		bool start_get_file(
+			std::string const & filename,
+			std::string const & local_filename,
+			completion_handler handler );
+		bool start_put_file(
+			std::string const & filename,
+			completion_handler handler );
+		bool is_transfer_started() const noexcept;
+
+		// Transfer engine
+		bool set_transfer_engine( transfer_engine_kind kind );
+		transfer_engine_kind get_transfer_engine() const noexcept;
+		std::int64_t get_transferred_bytes() const noexcept;
+
+		// Socket tuning
+		void set_data_profile( socket_profile const & profile );
+		void set_connect_policy( connect_policy const & policy ) noexcept;
+		connect_metrics get_connect_metrics() const noexcept;
+		connect_metrics get_data_connect_metrics() const noexcept;
 
 		std::string get_host_address() const noexcept;
 
 	private:
 		void init();
+		bool connect_endpoints(
+			std::string const & host,
+			std::vector< endpoint > const & endpoints );
+		void query_features();
+		bool lacks_capability( ftp_capability capability ) const noexcept;
 		bool send_pasv();
+		ftp_verb get_passive_command() const;
+		bool parse_pasv_reply();
+		void prefetch_data_connection();
+		bool send_command_line( ftp_verb command );
 		bool start_data_connection(
-			std::string const & command,
-			std::string const & parameter );
-		void stop_data_connection( bool abort );
-		bool send_command();
-		bool receive_reply();
+			ftp_verb command,
+			std::string_view parameter = {} );
+		bool stop_data_connection( bool abort );
+		bool send_abort();
+		bool drain_abort_replies();
+		bool get_binary_file(
+			std::string const & filename,
+			std::string const & local_filename );
+		bool put_binary_file( std::string const & filename );
+		std::int64_t send_all_data(
+			void const * data,
+			std::size_t size,
+			bool zero_copy );
+		std::int64_t receive_data_to_file( int file_handle );
+		std::int64_t send_file_data( int file_handle );
+		bool send_compressed_data( bool finish );
+		int receive_compressed_data(
+			void* buffer,
+			std::size_t buffer_size );
+		bool get_resumable_file(
+			std::string const & filename,
+			std::string const & local_filename );
+		bool receive_listing(
+			ftp_verb command,
+			std::string const & directory,
+			std::string& listing );
+		bool put_resumable_file( std::string const & filename );
+		bool is_transfer_complete(
+			std::int64_t bytes,
+			std::int64_t announced_bytes ) const;
+		reply_view send_encoded_commands();
+		reply_view send_command(
+			IOVEC* buffers,
+			std::size_t buffer_count );
+		reply_view receive_reply();
+		void keep_reply( reply_view const & reply );
+		void clear_reply() noexcept;
+		bool send_command_buffers(
+			IOVEC* buffers,
+			std::size_t buffer_count );
+		bool wait_command_writable();
+		void receive_command_events( std::uint32_t events );
+		void handle_data_events( std::uint32_t events );
+		bool start_transfer(
+			ftp_verb command,
+			std::string const & filename,
+			int file_handle,
+			completion_handler handler );
+		void advance_transfer();
+		bool connect_started_transfer();
+		bool receive_started_transfer();
+		bool send_started_transfer();
+		void end_started_data();
+		void fail_started_transfer();
+		void finish_started_transfer( bool succeeded );
 
 		// Command socket
 		socket command_socket;
 		// Data socket
 		socket data_socket;
+		// Data sockets created and tuned ahead of their connection
+		socket_pool data_socket_pool { socket_profile::bulk() };
 		// Max message size
 		static constexpr auto FTP_MAX_MSG = 4096;
 		// Message buffer
 		std::array< char, FTP_MAX_MSG > message {};
+		// Command lines to send on the command socket
+		command_encoder encoder;
+		// Replies received on the command socket
+		reply_parser replies;
+		// Last reply received, its text null terminated, and the function
+		// it is passed to
+		int reply_code = 0;
+		std::size_t reply_length = 0;
+		std::array< char, reply_parser::CAPACITY + 1 > reply_text {};
+		reply_handler reply_listener;
+		listing_handler listing_listener;
 		// True for ASCII, false for binary
 		bool transfer_type = false;
 		// Host address
 		std::string host_address;
+		// Credentials, kept for opening further sessions
+		std::string user_name;
+		std::string user_password;
+		// Features listed by the server (FEAT command), once queried
+		std::vector< std::string > features;
+		bool features_known = false;
+		// Capabilities of the server, once discovered or found in the file
+		// caching them, and the greeting identifying the server there
+		capability_set capabilities;
+		bool capabilities_known = false;
+		std::string server_banner;
+		std::string capability_cache_path = capability_cache::get_default_path();
+		// Resolved host names, cached for the session
+		std::shared_ptr< resolver > name_resolver = std::make_shared< resolver >();
+		// Address the command socket is connected to
+		endpoint server_endpoint;
 		// Port for transferring data
 		std::uint16_t data_port = 0;
+		// Block mode (RFC 959, section 3.4.2) framing: a 3 byte header
+		// holding a descriptor and the size of the data that follows
+		static constexpr std::size_t BLOCK_HEADER_SIZE = 3;
+		static constexpr std::size_t BLOCK_MAXIMUM_SIZE = 0xffff;
+		static constexpr unsigned char BLOCK_END_OF_FILE = 0x40;
+		static constexpr unsigned char BLOCK_RESTART_MARKER = 0x10;
+
+		// Whether the current transfer sends data
+		bool sending_data = false;
+		// Whether transfers use block mode, and the state of the current one
+		bool block_mode = false;
+		std::size_t block_remaining = 0;
+		bool block_last = false;
+		bool block_end_of_file = false;
+		// Whether transfers use compressed mode, the streams compressing
+		// uploads and decompressing downloads, and the compressed data
+		static constexpr std::size_t COMPRESSED_BUFFER_SIZE = 64 * 1024;
+		bool compressed_mode = false;
+		std::unique_ptr< deflate_stream > compressor;
+		std::unique_ptr< deflate_stream > decompressor;
+		std::vector< unsigned char > compressed_data;
+		// Whether transfers prefetch the passive port of the next one, and
+		// whether the data socket is connected to such a port
+		bool pasv_prefetch = false;
+		bool data_prefetched = false;
+		// Whether login pipelines its commands
+		bool fast_login = false;
+		// Whether a transfer command was accepted and not yet completed, and
+		// whether it was cancelled; set from signal handlers
+		volatile std::sig_atomic_t transfer_open = 0;
+		volatile std::sig_atomic_t cancel_requested = 0;
+		// Whether binary transfers keep a checkpoint to resume from
+		bool resumable = false;
+		// Engine moving binary transfers between the data socket and files
+		std::unique_ptr< transfer_engine > engine = transfer_engine::create( transfer_engine_kind::standard );
+		// Bytes moved by the last file transfer
+		std::int64_t transferred_bytes = 0;
+
+		// Steps of a transfer driven by a reactor
+		enum class transfer_step
+		{
+			// Waiting for the reply to PASV or EPSV
+			passive,
+			// Connecting the data socket to the passive port
+			connecting,
+			// Moving data, until the data connection and the completion
+			// reply have both ended
+			transferring,
+			// Draining the replies to ABOR, up to the reply to NOOP
+			aborting
+		};
+
+		// State of the transfer started on a reactor
+		struct started_transfer
+		{
+			transfer_step step = transfer_step::passive;
+			ftp_verb command = ftp_verb::RETR;
+			std::string filename;
+			int file_handle = -1;
+			// Command asking for the passive port, and whether it is the
+			// other one, asked for after a refusal
+			ftp_verb passive_command = ftp_verb::EPSV;
+			bool passive_fallback = false;
+			// Whether the data connection ended, and whether it succeeded
+			bool data_done = false;
+			bool data_succeeded = false;
+			// Whether the completion reply arrived
+			bool completed = false;
+			std::int64_t bytes = 0;
+			std::int64_t announced_bytes = -1;
+			// File data read ahead of an upload, the part of it sent, and
+			// data received ahead of a write
+			std::vector< char > buffer;
+			std::size_t buffer_start = 0;
+			std::size_t buffer_end = 0;
+			completion_handler handler;
+		};
+
+		// Reactor the sockets are registered with, if attached
+		reactor* events = nullptr;
+		// Whether the command socket became writable, after a partial send
+		bool command_writable = false;
+		// Transfer started on the reactor, until it ends
+		std::unique_ptr< started_transfer > started;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,75 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "socket.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace networking
+{
+	// Class implementing a single-threaded event loop on top of epoll.
+	// Sockets registered with the reactor are switched to non-blocking
+	// mode and their handler is invoked whenever they become ready, so
+	// that one thread can drive many command and data sockets at once.
+	// Only available on Linux; elsewhere, the reactor never opens.
+	// Handlers may call poll() again, as a session waiting for a reply does.
+	class reactor
+	{
+	public:
+		// Readiness events a handler can subscribe to or be notified of
+		enum event : std::uint32_t
+		{
+			readable = 1 << 0,
+			writable = 1 << 1,
+			error = 1 << 2,
+			hangup = 1 << 3
+		};
+
+		using handler = std::function< void( std::uint32_t events ) >;
+
+		reactor() noexcept;
+		virtual ~reactor() noexcept;
+
+		reactor( reactor const & ) = delete;
+		reactor( reactor&& ) noexcept = delete;
+
+		reactor& operator=( reactor const & ) = delete;
+		reactor& operator=( reactor&& ) noexcept = delete;
+
+		bool is_open() const noexcept;
+		std::size_t size() const noexcept;
+
+		bool add(
+			socket& target,
+			std::uint32_t events,
+			handler callback );
+		bool modify(
+			socket const & target,
+			std::uint32_t events ) noexcept;
+		bool remove( socket const & target ) noexcept;
+
+		int poll( int timeout_milliseconds );
+		void run();
+		void stop() noexcept;
+
+	private:
+		// Event poll handle
+		int poll_handle = -1;
+		// Handlers of the registered sockets
+		std::unordered_map< SOCKET, handler > handlers;
+		// Handlers removed while events are dispatched, kept alive until
+		// the dispatch ends, as one of them may be running
+		std::vector< std::unordered_map< SOCKET, handler >::node_type > removed_handlers;
+		// Dispatches in progress, more than one when a handler polls
+		std::size_t dispatch_depth = 0;
+		// True while run() should keep dispatching events
+		bool running = false;
+	};
+}
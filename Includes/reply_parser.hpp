@@ -0,0 +1,121 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace networking
+{
+	// Class of a reply, given by the first digit of its code (RFC 959,
+	// section 4.2.1)
+	enum class reply_class : std::uint8_t
+	{
+		none,
+		positive_preliminary,
+		positive_completion,
+		positive_intermediate,
+		transient_negative,
+		permanent_negative
+	};
+
+	// Reply of the server (RFC 959, section 4.2): a three digit code and
+	// one or more lines of text, line endings included. The text refers to
+	// the buffer of the parser and is valid until it receives more bytes.
+	struct reply_view
+	{
+		// Lines of the text, without their line endings
+		class line_range
+		{
+		public:
+			class iterator
+			{
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = std::string_view;
+				using difference_type = std::ptrdiff_t;
+				using pointer = std::string_view const *;
+				using reference = std::string_view const &;
+
+				iterator() = default;
+				explicit iterator( std::string_view remaining ) noexcept;
+
+				reference operator*() const noexcept;
+				pointer operator->() const noexcept;
+				iterator& operator++() noexcept;
+				iterator operator++( int ) noexcept;
+
+				bool operator==( iterator const & other ) const noexcept;
+				bool operator!=( iterator const & other ) const noexcept;
+
+			private:
+				void find_line() noexcept;
+
+				// Text from the current line on
+				std::string_view remaining;
+				std::string_view line;
+			};
+
+			explicit line_range( std::string_view text ) noexcept;
+
+			iterator begin() const noexcept;
+			iterator end() const noexcept;
+
+		private:
+			std::string_view text;
+		};
+
+		// Reply code, or 0 for a line without one, or for no reply at all
+		int code = 0;
+		std::string_view text;
+
+		// Whether the reply accepts the command (1xx to 3xx)
+		explicit operator bool() const noexcept;
+
+		reply_class get_class() const noexcept;
+		bool is_positive() const noexcept;
+		bool is_preliminary() const noexcept;
+		line_range lines() const noexcept;
+	};
+
+	// Class splitting the bytes received on a command connection into
+	// replies, as they arrive. Bytes are received straight into a fixed
+	// ring buffer and each byte is scanned once, wherever the segments
+	// split the replies; nothing is allocated.
+	// Once the write position reaches the end of the buffer, the bytes not
+	// yet consumed move to its front, so that a reply is always contiguous.
+	// A reply longer than the buffer keeps its first line and the lines
+	// that fit after it.
+	class reply_parser
+	{
+	public:
+		static constexpr std::size_t CAPACITY = 16 * 1024;
+
+		char* prepare( std::size_t& size ) noexcept;
+		void commit( std::size_t size ) noexcept;
+		bool next( reply_view& reply ) noexcept;
+		bool has_pending() const noexcept;
+		void clear() noexcept;
+
+	private:
+		void make_room() noexcept;
+
+		std::array< char, CAPACITY > buffer;
+		// Received bytes not yet consumed, from the start of the next reply
+		std::size_t start = 0;
+		std::size_t end = 0;
+		// Offsets from the start: bytes scanned for line endings, the line
+		// being scanned, and the end of the first line of the reply
+		std::size_t scanned = 0;
+		std::size_t line_start = 0;
+		std::size_t first_line_end = 0;
+		// Code of the reply, once its first line is complete
+		int code = 0;
+	};
+}
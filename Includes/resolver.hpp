@@ -0,0 +1,54 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "endpoint.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace networking
+{
+	// Class resolving host names with getaddrinfo.
+	// Results are cached for the given time to live, so that a session
+	// resolves its server once, and are ordered for Happy Eyeballs
+	// (RFC 8305): address families alternate, starting with the one
+	// getaddrinfo prefers.
+	class resolver
+	{
+	public:
+		explicit resolver( std::chrono::seconds time_to_live = std::chrono::seconds( 300 ) );
+
+		resolver( resolver const & ) = delete;
+		resolver& operator=( resolver const & ) = delete;
+
+		std::vector< endpoint > resolve(
+			std::string const & host,
+			std::uint16_t port );
+		void clear();
+
+		static std::vector< endpoint > lookup(
+			std::string const & host,
+			std::uint16_t port );
+
+	private:
+		struct entry
+		{
+			std::vector< endpoint > endpoints;
+			std::chrono::steady_clock::time_point expiry;
+		};
+
+		// Lifetime of cached results
+		std::chrono::seconds time_to_live;
+		// Cached results by host name
+		std::unordered_map< std::string, entry > cache;
+		std::mutex cache_mutex;
+	};
+}
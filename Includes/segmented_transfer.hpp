@@ -0,0 +1,106 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace networking
+{
+	class ftp_processor;
+
+	// Class transferring a file over several sessions of the same server,
+	// each moving a byte range (segment) of it with REST and RETR or STOR.
+	// The origin session takes part in the transfer from the calling
+	// thread; the other sessions are opened with its credentials, one per
+	// thread. A session left without work splits the largest segment still
+	// in progress, so that a slow connection does not hold back the others.
+	class segmented_transfer
+	{
+	public:
+		// Smallest segment worth a session of its own
+		static constexpr std::int64_t MINIMUM_SEGMENT_SIZE = 4 * 1024 * 1024;
+
+		segmented_transfer(
+			ftp_processor& origin,
+			std::size_t session_count );
+
+		segmented_transfer( segmented_transfer const & ) = delete;
+		segmented_transfer& operator=( segmented_transfer const & ) = delete;
+
+		bool download(
+			std::string const & remote_filename,
+			std::string const & local_filename,
+			std::int64_t file_size );
+		bool upload(
+			std::string const & local_filename,
+			std::string const & remote_filename,
+			std::int64_t file_size );
+
+		std::int64_t get_transferred_bytes() const noexcept;
+
+	private:
+		// Byte range [position, end) of the file. The end is lowered when
+		// another session takes over the back half of the range.
+		struct segment
+		{
+			segment(
+				std::int64_t position,
+				std::int64_t end ) noexcept;
+
+			std::atomic< std::int64_t > position;
+			std::atomic< std::int64_t > end;
+			// Whether a session is currently transferring the segment
+			bool active = false;
+		};
+
+		void split_file( std::int64_t file_size );
+		bool run(
+			std::string const & remote_filename,
+			int file_handle,
+			segment* opened_segment );
+		void run_session(
+			ftp_processor& session,
+			std::string const & remote_filename,
+			int file_handle,
+			segment* opened_segment );
+		bool download_segment(
+			ftp_processor& session,
+			segment& current,
+			std::string const & remote_filename,
+			int file_handle,
+			std::vector< char >& buffer );
+		bool upload_segment(
+			ftp_processor& session,
+			segment& current,
+			std::string const & remote_filename,
+			int file_handle,
+			std::vector< char >& buffer,
+			bool opened );
+		segment* next_segment();
+		void release_segment( segment& current );
+
+		ftp_processor& origin;
+		std::size_t session_count;
+		// Direction of the current transfer
+		bool uploading = false;
+		// Directory the origin session is in
+		std::string directory;
+
+		// Segments, including those split off at run time; a deque keeps
+		// them in place as it grows
+		std::deque< segment > segments;
+		// Segments waiting for a session
+		std::vector< segment* > pending_segments;
+		std::mutex segments_mutex;
+
+		std::atomic< std::int64_t > transferred_bytes { 0 };
+	};
+}
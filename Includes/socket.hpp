@@ -3,36 +3,148 @@
  * MIT License (MIT), http://opensource.org/licenses/MIT
  */
 
+#pragma once
+
+#include "endpoint.hpp"
+
 #ifdef __linux__
+	#include <sys/uio.h>
+
 	using SOCKET = int;
+	// Buffer of a scatter/gather operation
+	using IOVEC = struct iovec;
 #elif _WIN32
 	#include <WinSock2.h>
+
+	using IOVEC = WSABUF;
 #endif
 
+#include <chrono>
+#include <cstdint>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace networking
 {
+	// TCP options applied to a socket when it is created.
+	// Zero or empty values keep the system default.
+	struct socket_profile
+	{
+		// Disable Nagle's algorithm (TCP_NODELAY)
+		bool no_delay = false;
+		// Acknowledge segments immediately (TCP_QUICKACK, Linux only)
+		bool quick_ack = false;
+		// Only send full segments until uncorked (TCP_CORK, Linux only)
+		bool cork = false;
+		// Kernel buffer sizes (SO_RCVBUF/SO_SNDBUF); setting them turns
+		// off the kernel's automatic buffer tuning for the socket, so they
+		// are only applied when the system grants the whole size
+		int receive_buffer_size = 0;
+		int send_buffer_size = 0;
+		// Unsent bytes queued before the socket stops being writable (TCP_NOTSENT_LOWAT, Linux only)
+		int not_sent_low_water_mark = 0;
+		// Bytes buffered before a receive completes (SO_RCVLOWAT)
+		int receive_low_water_mark = 0;
+		// Congestion control algorithm, such as "bbr" or "cubic" (TCP_CONGESTION, Linux only)
+		std::string congestion_control;
+
+		// Profile for latency-bound command connections
+		static socket_profile control();
+		// Profile for throughput-bound data connections
+		static socket_profile bulk(
+			std::string const & congestion_control = "",
+			int buffer_size = 0 );
+	};
+
+	// Timeouts and retries of connection attempts
+	struct connect_policy
+	{
+		// Bound of a single attempt
+		std::chrono::milliseconds attempt_timeout { 3000 };
+		// Bound of all attempts, including the delays between them
+		std::chrono::milliseconds overall_timeout { 15000 };
+		// Delay before the first retry; it doubles after each failure
+		std::chrono::milliseconds initial_backoff { 100 };
+		std::chrono::milliseconds max_backoff { 2000 };
+		unsigned max_attempts = 10;
+	};
+
+	// Outcome of the last connection
+	struct connect_metrics
+	{
+		unsigned attempts = 0;
+		// Time-to-connect if connected, time-to-failure otherwise
+		std::chrono::microseconds elapsed { 0 };
+		bool connected = false;
+	};
+
+	// Makes a scatter/gather buffer over the given bytes
+	inline IOVEC
+	make_buffer(
+		void const * data,
+		std::size_t size ) noexcept
+	{
+		IOVEC buffer = {};
+
+	#ifdef __linux__
+		buffer.iov_base = const_cast< void* >( data );
+		buffer.iov_len = size;
+	#elif _WIN32
+		buffer.buf = static_cast< CHAR* >( const_cast< void* >( data ) );
+		buffer.len = static_cast< ULONG >( size );
+	#endif
+
+		return buffer;
+	}
+
 	class socket
 	{
 	public:
+		// Returned by send_message/receive_message on a non-blocking
+		// socket when the operation would have blocked.
+		static constexpr int WOULD_BLOCK = -1;
+		// Returned by receive_message when the connection failed, so that
+		// a reset is not taken for the end of the stream.
+		static constexpr int FAILED = -2;
+		// Port used when none is given
+		static constexpr std::uint16_t DEFAULT_PORT = 21;
+		// Sends smaller than this are copied; pinning pages and handling
+		// the completion costs more than copying them.
+		static constexpr std::size_t ZERO_COPY_THRESHOLD = 16 * 1024;
 
 		socket() = default;
 		virtual ~socket() noexcept;
 
 		socket( socket const & ) = delete;
-		socket( socket&& ) noexcept = delete;
+		socket( socket&& other ) noexcept;
 
 		socket& operator=( socket const & ) = delete;
-		socket& operator=( socket&& ) noexcept = delete;
+		socket& operator=( socket&& other ) noexcept;
 
 		bool is_connected() const noexcept;
+		bool is_blocking() const noexcept;
+		bool is_prepared() const noexcept;
+		int get_prepared_family() const noexcept;
+		SOCKET get_handle() const noexcept;
 
 		bool connect_client_socket(
 			std::string const & host_address,
 			std::uint16_t port = 0 ) noexcept;
+		bool connect_client_socket( std::vector< endpoint > const & endpoints ) noexcept;
+		bool connect_client_socket( endpoint const & peer ) noexcept;
+		bool start_connect_client_socket( endpoint const & peer ) noexcept;
+		bool finish_connect_client_socket() noexcept;
+		endpoint get_peer_endpoint() const noexcept;
+		bool prepare( int family ) noexcept;
+		void release_prepared() noexcept;
+		bool set_blocking( bool blocking ) noexcept;
+		void set_profile( socket_profile const & profile );
+		bool set_receive_low_water_mark( int bytes ) noexcept;
+		void set_connect_policy( connect_policy const & policy ) noexcept;
+		connect_metrics get_connect_metrics() const noexcept;
 		void close() noexcept;
+		void shutdown() const noexcept;
 
 		int send_message(
 			void* buffer,
@@ -43,8 +155,64 @@ namespace networking
 		int receive_message_all(
 			void* buffer,
 			std::size_t buffer_size ) const noexcept;
+		int send_urgent_message(
+			void const * buffer,
+			std::size_t buffer_size ) const noexcept;
+		int send_message(
+			IOVEC const * buffers,
+			std::size_t buffer_count ) const noexcept;
+		int send_message_all(
+			IOVEC* buffers,
+			std::size_t buffer_count ) const noexcept;
+		int receive_message(
+			IOVEC const * buffers,
+			std::size_t buffer_count ) const noexcept;
+		std::int64_t send_file(
+			int file_handle,
+			std::uint64_t size ) const noexcept;
+		std::int64_t receive_to_file( int file_handle ) const noexcept;
+		std::int64_t send_message_zero_copy(
+			void const * buffer,
+			std::size_t buffer_size ) noexcept;
 
 	private:
-		SOCKET socket_handle = 0;
+		// State of MSG_ZEROCOPY on this socket
+		enum class zero_copy_state
+		{
+			unknown,
+			enabled,
+			disabled
+		};
+
+		bool would_block() const noexcept;
+		bool apply_profile(
+			SOCKET handle,
+			bool connected,
+			bool with_buffers ) const noexcept;
+		bool connect_with_retries(
+			endpoint const * endpoints,
+			std::size_t count ) noexcept;
+		bool connect_attempt(
+			endpoint const * endpoints,
+			std::size_t count,
+			std::chrono::milliseconds timeout ) noexcept;
+		SOCKET start_connect(
+			endpoint const & peer,
+			bool& connected ) noexcept;
+		SOCKET open_handle( int family ) const noexcept;
+		bool enable_zero_copy() noexcept;
+		bool wait_zero_copy_completions(
+			std::uint32_t& completed,
+			bool& copied ) const noexcept;
+
+		SOCKET socket_handle = static_cast< SOCKET >( -1 );
+		// Socket created and tuned ahead of the next connection
+		SOCKET prepared_handle = static_cast< SOCKET >( -1 );
+		int prepared_family = 0;
+		bool blocking = true;
+		zero_copy_state zero_copy = zero_copy_state::unknown;
+		socket_profile profile;
+		connect_policy policy;
+		connect_metrics metrics;
 	};
-}
\ No newline at end of file
+}
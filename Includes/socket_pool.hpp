@@ -0,0 +1,48 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "socket.hpp"
+
+#include <vector>
+
+namespace networking
+{
+	// Class keeping data sockets created and tuned ahead of time, so that
+	// opening a data connection only costs the connect itself.
+	// Prepared sockets are refilled off the transfer path with fill().
+	class socket_pool
+	{
+	public:
+		explicit socket_pool(
+			socket_profile const & profile = socket_profile(),
+			std::size_t capacity = 2 );
+
+		socket_pool( socket_pool const & ) = delete;
+		socket_pool( socket_pool&& ) noexcept = default;
+
+		socket_pool& operator=( socket_pool const & ) = delete;
+		socket_pool& operator=( socket_pool&& ) noexcept = default;
+
+		std::size_t size() const noexcept;
+
+		socket acquire( int family );
+		void fill( int family );
+		void clear() noexcept;
+
+		void set_profile( socket_profile const & profile );
+		void set_connect_policy( connect_policy const & policy ) noexcept;
+
+	private:
+		// Prepared sockets
+		std::vector< socket > sockets;
+		// Options of the pooled sockets
+		socket_profile profile;
+		connect_policy policy;
+		// Number of sockets kept prepared
+		std::size_t capacity;
+	};
+}
@@ -0,0 +1,54 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace networking
+{
+	// Class recording the progress of a binary transfer in a sidecar file
+	// next to the local file, so that an interrupted transfer resumes
+	// where it stopped (REST command) instead of starting over.
+	// The sidecar holds the size of the whole file, the offset up to which
+	// the transfer is known good, and an Adler-32 checksum of the local
+	// bytes before that offset, so that a local file modified in between
+	// is not resumed.
+	class transfer_checkpoint
+	{
+	public:
+		// Suffix of the sidecar file name
+		static constexpr char const * SUFFIX = ".ftp-checkpoint";
+
+		explicit transfer_checkpoint( std::string const & filename );
+
+		bool load();
+		bool save() const;
+		void remove() const;
+
+		void reset( std::int64_t file_size ) noexcept;
+		void update(
+			void const * data,
+			std::size_t size ) noexcept;
+		bool verify( int file_handle ) const;
+		bool rewind(
+			int file_handle,
+			std::int64_t offset );
+
+		std::int64_t get_file_size() const noexcept;
+		std::int64_t get_offset() const noexcept;
+
+	private:
+		// Path of the sidecar file
+		std::string path;
+		// Size of the whole file, or -1 if unknown
+		std::int64_t file_size = -1;
+		// Number of bytes known good
+		std::int64_t offset = 0;
+		// Adler-32 checksum of those bytes
+		std::uint32_t checksum = 1;
+	};
+}
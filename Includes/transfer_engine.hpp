@@ -0,0 +1,74 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "socket.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace networking
+{
+	// Engines available for moving bulk data on the data connection
+	enum class transfer_engine_kind
+	{
+		// Blocking socket calls and file descriptor reads/writes
+		standard,
+		// Batched, linked io_uring submissions (Linux only)
+		io_uring
+	};
+
+	// Interface of the engines moving the content of a binary transfer
+	// between a connected data socket and a local file descriptor.
+	// Both operations return the number of bytes moved, or -1 on failure.
+	class transfer_engine
+	{
+	public:
+		transfer_engine() = default;
+		virtual ~transfer_engine() noexcept = default;
+
+		transfer_engine( transfer_engine const & ) = delete;
+		transfer_engine( transfer_engine&& ) noexcept = delete;
+
+		transfer_engine& operator=( transfer_engine const & ) = delete;
+		transfer_engine& operator=( transfer_engine&& ) noexcept = delete;
+
+		virtual transfer_engine_kind get_kind() const noexcept = 0;
+
+		// Receives from the socket until the partner closes it and writes
+		// everything at the current position of the file
+		virtual std::int64_t receive_to_file(
+			socket const & source,
+			int file_handle ) noexcept = 0;
+		// Sends the file from its current position up to its end
+		virtual std::int64_t send_from_file(
+			int file_handle,
+			socket const & sink ) noexcept = 0;
+
+		// Creates the requested engine, falling back to the standard
+		// engine when the requested one is unavailable on this system.
+		static std::unique_ptr< transfer_engine > create( transfer_engine_kind kind );
+	};
+
+	// Engine copying the data through a user space buffer with
+	// regular blocking calls.
+	class standard_transfer_engine final : public transfer_engine
+	{
+	public:
+		transfer_engine_kind get_kind() const noexcept override;
+
+		std::int64_t receive_to_file(
+			socket const & source,
+			int file_handle ) noexcept override;
+		std::int64_t send_from_file(
+			int file_handle,
+			socket const & sink ) noexcept override;
+
+	private:
+		// Size of the intermediate buffer
+		static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+	};
+}
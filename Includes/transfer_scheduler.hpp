@@ -0,0 +1,107 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "ftp_processor.hpp"
+#include "reactor.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace networking
+{
+	// Class transferring many files over a pool of sessions of the same
+	// server (mget/mput). The files are dealt out largest first, each to
+	// the session with the fewest bytes queued; a session that empties its
+	// queue steals the smallest files left in the fullest queue of another.
+	// The origin session takes part from the calling thread, and the other
+	// sessions are opened with its credentials within the limit of sessions
+	// allowed per server. Stream transfers of all sessions are driven by a
+	// reactor from the calling thread; the others run one session per thread.
+	class transfer_scheduler
+	{
+	public:
+		// Sessions opened to a server at once, origin sessions included
+		static constexpr std::size_t DEFAULT_SERVER_LIMIT = 8;
+
+		transfer_scheduler(
+			ftp_processor& origin,
+			std::size_t session_count );
+
+		transfer_scheduler( transfer_scheduler const & ) = delete;
+		transfer_scheduler& operator=( transfer_scheduler const & ) = delete;
+
+		static void set_server_limit( std::size_t limit ) noexcept;
+
+		bool get_files( std::vector< std::string > const & patterns );
+		bool put_files( std::vector< std::string > const & patterns );
+		bool cancel() noexcept;
+
+		std::size_t get_transferred_files() const noexcept;
+		std::vector< std::string > const & get_failed_files() const noexcept;
+		std::vector< std::string > const & get_unmatched_patterns() const noexcept;
+
+	private:
+		struct job
+		{
+			std::string filename;
+			std::int64_t size;
+		};
+
+		// Files queued for one session, largest first
+		struct queue
+		{
+			std::deque< job > jobs;
+			std::int64_t queued_bytes = 0;
+			std::mutex mutex;
+		};
+
+		bool run(
+			std::vector< job > jobs,
+			bool uploading );
+		void run_threads(
+			std::string const & directory,
+			bool transfer_type,
+			bool uploading );
+		void run_reactor(
+			reactor& events,
+			std::string const & directory,
+			bool transfer_type,
+			bool uploading );
+		void run_session(
+			ftp_processor& session,
+			std::size_t index,
+			bool uploading );
+		bool next_job(
+			std::size_t index,
+			job& next );
+		void add_failure( std::string const & filename );
+
+		ftp_processor& origin;
+		std::size_t session_count;
+
+		// One queue per session; a deque keeps them in place
+		std::deque< queue > queues;
+		// Sessions opened besides the origin session, the one of queue
+		// "index" at "index - 1"
+		std::deque< ftp_processor > sessions;
+
+		// Whether a batch is running, with its sessions in place, and
+		// whether it was cancelled; set from signal handlers
+		volatile std::sig_atomic_t running = 0;
+		volatile std::sig_atomic_t cancelled = 0;
+
+		std::atomic< std::size_t > transferred_files { 0 };
+		std::vector< std::string > failed_files;
+		std::mutex failed_files_mutex;
+		std::vector< std::string > unmatched_patterns;
+	};
+}
@@ -0,0 +1,49 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#pragma once
+
+#include "transfer_engine.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace networking
+{
+	// Engine driving binary transfers through io_uring.
+	// Each submission carries a chain of socket reads linked to file
+	// writes (or file reads linked to socket sends) over a set of
+	// registered buffers, so that a whole chain costs a single system call.
+	// Only available on Linux; is_open() is false when the kernel lacks io_uring
+	// or one of the operations used (probed with IORING_REGISTER_PROBE).
+	class uring_transfer_engine final : public transfer_engine
+	{
+	public:
+		uring_transfer_engine() noexcept;
+		~uring_transfer_engine() noexcept override;
+
+		bool is_open() const noexcept;
+
+		transfer_engine_kind get_kind() const noexcept override;
+
+		std::int64_t receive_to_file(
+			socket const & source,
+			int file_handle ) noexcept override;
+		std::int64_t send_from_file(
+			int file_handle,
+			socket const & sink ) noexcept override;
+
+	private:
+		struct ring;
+
+		// Submission ring and registered buffers
+		std::unique_ptr< ring > uring;
+
+		// Size of each registered buffer
+		static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+		// Number of registered buffers, i.e. read/write pairs per chain
+		static constexpr std::size_t BUFFER_COUNT = 8;
+	};
+}
@@ -0,0 +1,225 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "capability_cache.hpp"
+
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace networking
+{
+	// Longest host name (RFC 1035, section 2.3.4), and its terminator
+	static constexpr std::size_t HOST_SIZE = 256;
+
+	// Sessions of the process share the file
+	static std::mutex cache_mutex;
+
+	// Entry of the file
+	struct cached_server
+	{
+		std::string host;
+		std::uint16_t port = 0;
+		std::uint64_t banner_hash = 0;
+		std::uint32_t flags = 0;
+	};
+
+	// Hashes the banner with 64 bit FNV-1a
+	static std::uint64_t
+	hash_banner( std::string const & banner ) noexcept
+	{
+		static constexpr std::uint64_t OFFSET_BASIS = 0xcbf29ce484222325;
+		static constexpr std::uint64_t PRIME = 0x100000001b3;
+
+		auto hash = OFFSET_BASIS;
+
+		for ( const auto character : banner )
+		{
+			hash = ( hash ^ static_cast< unsigned char >( character ) ) * PRIME;
+		}
+
+		return hash;
+	}
+
+	// Reads the entries of the file; a missing file holds none, and the
+	// entries after a malformed one are dropped
+	static std::vector< cached_server >
+	read_entries( std::string const & path )
+	{
+		std::vector< cached_server > entries;
+
+		auto* file = std::fopen( path.c_str(), "r" );
+
+		if ( file == nullptr )
+		{
+			return entries;
+		}
+
+		std::array< char, HOST_SIZE > host;
+		cached_server entry;
+
+		while ( std::fscanf( file, "%255s %" SCNu16 " %" SCNx64 " %" SCNx32, host.data(), &entry.port, &entry.banner_hash, &entry.flags ) == 4 )
+		{
+			entry.host = host.data();
+			entries.push_back( entry );
+		}
+
+		std::fclose( file );
+
+		return entries;
+	}
+
+	capability_set::capability_set( std::uint32_t flags ) noexcept :
+		flags( flags )
+	{
+	}
+
+	bool
+	capability_set::has( ftp_capability capability ) const noexcept
+	{
+		return ( this->flags & static_cast< std::uint32_t >( capability ) ) != 0;
+	}
+
+	// Whether the server answers FEAT and does not list the capability.
+	// A server without FEAT lacks nothing: its capabilities are unknown.
+	bool
+	capability_set::lacks( ftp_capability capability ) const noexcept
+	{
+		return this->has( ftp_capability::FEAT ) && !this->has( capability );
+	}
+
+	void
+	capability_set::add( ftp_capability capability ) noexcept
+	{
+		this->flags |= static_cast< std::uint32_t >( capability );
+	}
+
+	std::uint32_t
+	capability_set::get_flags() const noexcept
+	{
+		return this->flags;
+	}
+
+	// Returns the path of the file in the home directory of the user, or an
+	// empty path if there is none
+	std::string
+	capability_cache::get_default_path()
+	{
+	#ifdef _WIN32
+		auto const * home = std::getenv( "USERPROFILE" );
+	#else
+		auto const * home = std::getenv( "HOME" );
+	#endif
+
+		if ( ( home == nullptr ) || ( *home == 0 ) )
+		{
+			return {};
+		}
+
+		return std::string( home ) + "/" + FILENAME;
+	}
+
+	capability_cache::capability_cache( std::string path ) :
+		path( std::move( path ) )
+	{
+	}
+
+	// Looks up the capabilities of a server; returns false if they are not
+	// in the file
+	bool
+	capability_cache::find(
+		std::string const & host,
+		std::uint16_t port,
+		std::string const & banner,
+		capability_set& capabilities ) const
+	{
+		if ( this->path.empty() )
+		{
+			return false;
+		}
+
+		const auto banner_hash = hash_banner( banner );
+
+		std::lock_guard< std::mutex > lock( cache_mutex );
+
+		for ( auto const & entry : read_entries( this->path ) )
+		{
+			if ( ( entry.host == host ) && ( entry.port == port ) && ( entry.banner_hash == banner_hash ) )
+			{
+				capabilities = capability_set( entry.flags );
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Records the capabilities of a server, replacing those of its previous
+	// banner. The file is replaced as a whole, so that an interruption
+	// leaves either the previous or the new entries.
+	bool
+	capability_cache::store(
+		std::string const & host,
+		std::uint16_t port,
+		std::string const & banner,
+		capability_set capabilities ) const
+	{
+		if ( this->path.empty() || host.empty() || ( host.size() >= HOST_SIZE ) )
+		{
+			return false;
+		}
+
+		std::lock_guard< std::mutex > lock( cache_mutex );
+
+		auto entries = read_entries( this->path );
+		bool found = false;
+
+		for ( auto& entry : entries )
+		{
+			if ( ( entry.host == host ) && ( entry.port == port ) )
+			{
+				entry.banner_hash = hash_banner( banner );
+				entry.flags = capabilities.get_flags();
+				found = true;
+			}
+		}
+
+		if ( !found )
+		{
+			entries.push_back( { host, port, hash_banner( banner ), capabilities.get_flags() } );
+		}
+
+		const auto temporary_path = this->path + ".tmp";
+
+		auto* file = std::fopen( temporary_path.c_str(), "w" );
+
+		if ( file == nullptr )
+		{
+			return false;
+		}
+
+		bool written = true;
+
+		for ( auto const & entry : entries )
+		{
+			written = written &&
+				( std::fprintf( file, "%s %" PRIu16 " %016" PRIx64 " %08" PRIx32 "\n", entry.host.c_str(), entry.port, entry.banner_hash, entry.flags ) > 0 );
+		}
+
+		if ( ( std::fclose( file ) != 0 ) || !written )
+		{
+			std::remove( temporary_path.c_str() );
+
+			return false;
+		}
+
+		return std::rename( temporary_path.c_str(), this->path.c_str() ) == 0;
+	}
+}
@@ -0,0 +1,118 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "command_encoder.hpp"
+
+#include <cstring>
+
+namespace networking
+{
+	// Whether every verb of the table is three or four capital letters and
+	// the table is sorted without duplicates, as ftp_verb is. The array
+	// has one entry per verb, so a missing one is left empty and fails.
+	static constexpr bool
+	is_verb_table_valid() noexcept
+	{
+		for ( std::size_t idx = 0; idx < FTP_VERBS.size(); ++idx )
+		{
+			const auto verb = FTP_VERBS[idx];
+
+			if ( ( verb.size() < 3 ) || ( verb.size() > 4 ) || ( ( idx > 0 ) && !( FTP_VERBS[idx - 1] < verb ) ) )
+			{
+				return false;
+			}
+
+			for ( const auto character : verb )
+			{
+				if ( ( character < 'A' ) || ( character > 'Z' ) )
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// The verbs of the table are known to be well formed, so they are
+	// written without checks
+	static_assert( is_verb_table_valid(), "FTP_VERBS is not a sorted table of verbs" );
+	static_assert( to_string( ftp_verb::ABOR ) == "ABOR", "FTP_VERBS does not follow ftp_verb" );
+	static_assert( to_string( ftp_verb::USER ) == "USER", "FTP_VERBS does not follow ftp_verb" );
+
+	// Appends the command line of a known command
+	bool
+	command_encoder::append(
+		ftp_verb verb,
+		std::string_view argument ) noexcept
+	{
+		return this->append( to_string( verb ), argument );
+	}
+
+	// Appends a command line. Returns false, leaving the buffer as it was,
+	// if the line does not fit, if the verb is empty or if either holds a
+	// line ending, which would let it smuggle in another command.
+	bool
+	command_encoder::append(
+		std::string_view verb,
+		std::string_view argument ) noexcept
+	{
+		static constexpr char end_of_line[] = "\r\n";
+		static constexpr std::size_t end_of_line_length = sizeof( end_of_line ) - 1;
+
+		const auto line_length = verb.size() + ( argument.empty() ? 0 : argument.size() + 1 ) + end_of_line_length;
+
+		if ( verb.empty() ||
+			 ( line_length > CAPACITY - this->length ) ||
+			 ( verb.find_first_of( "\r\n" ) != std::string_view::npos ) ||
+			 ( argument.find_first_of( "\r\n" ) != std::string_view::npos ) )
+		{
+			return false;
+		}
+
+		auto* position = this->buffer.data() + this->length;
+
+		std::memcpy( position, verb.data(), verb.size() );
+		position += verb.size();
+
+		if ( !argument.empty() )
+		{
+			*position++ = ' ';
+
+			std::memcpy( position, argument.data(), argument.size() );
+			position += argument.size();
+		}
+
+		std::memcpy( position, end_of_line, end_of_line_length );
+
+		this->length += line_length;
+
+		return true;
+	}
+
+	void
+	command_encoder::clear() noexcept
+	{
+		this->length = 0;
+	}
+
+	char const *
+	command_encoder::data() const noexcept
+	{
+		return this->buffer.data();
+	}
+
+	std::size_t
+	command_encoder::size() const noexcept
+	{
+		return this->length;
+	}
+
+	bool
+	command_encoder::empty() const noexcept
+	{
+		return this->length == 0;
+	}
+}
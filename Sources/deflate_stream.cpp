@@ -0,0 +1,213 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "deflate_stream.hpp"
+
+#include <algorithm>
+
+namespace networking
+{
+	// Output of a window, in percent of its input, above which the data
+	// compresses poorly, and below which it compresses well
+	static constexpr std::uint64_t POOR_RATIO = 90;
+	static constexpr std::uint64_t GOOD_RATIO = 50;
+	// Windows stored before compression is tried again
+	static constexpr unsigned STORED_WINDOW_COUNT = 4;
+
+	deflate_stream::deflate_stream( bool compressing ) :
+		compressing( compressing )
+	{
+		this->valid = compressing ?
+			( ::deflateInit( &this->stream, DEFAULT_LEVEL ) == Z_OK ) :
+			( ::inflateInit( &this->stream ) == Z_OK );
+	}
+
+	deflate_stream::~deflate_stream() noexcept
+	{
+		if ( this->valid )
+		{
+			this->compressing ? ::deflateEnd( &this->stream ) : ::inflateEnd( &this->stream );
+		}
+	}
+
+	bool
+	deflate_stream::is_valid() const noexcept
+	{
+		return this->valid;
+	}
+
+	// Starts a new stream, for the next transfer
+	bool
+	deflate_stream::reset() noexcept
+	{
+		if ( !this->valid )
+		{
+			return false;
+		}
+
+		this->stream.next_in = nullptr;
+		this->stream.avail_in = 0;
+		this->finished = false;
+		this->next_level = DEFAULT_LEVEL;
+		this->window_input = 0;
+		this->window_output = 0;
+		this->stored_windows = 0;
+
+		return ( this->compressing ? ::deflateReset( &this->stream ) : ::inflateReset( &this->stream ) ) == Z_OK;
+	}
+
+	// Sets the data to compress or decompress next. It must stay in place
+	// until has_input() returns false.
+	void
+	deflate_stream::set_input(
+		void const * data,
+		std::size_t size ) noexcept
+	{
+		this->stream.next_in = static_cast< Bytef* >( const_cast< void* >( data ) );
+		this->stream.avail_in = static_cast< uInt >( size );
+	}
+
+	bool
+	deflate_stream::has_input() const noexcept
+	{
+		return this->stream.avail_in > 0;
+	}
+
+	// Compresses input into the output buffer; if finishing, the end of the
+	// stream is produced once all input is consumed.
+	// Returns the number of bytes produced, or -1 on failure. A full output
+	// buffer may leave more output pending.
+	int
+	deflate_stream::compress(
+		void* output,
+		std::size_t output_size,
+		bool finish ) noexcept
+	{
+		if ( !this->valid || !this->compressing )
+		{
+			return -1;
+		}
+
+		this->stream.next_out = static_cast< Bytef* >( output );
+		this->stream.avail_out = static_cast< uInt >( output_size );
+
+		const auto total_input = this->stream.total_in;
+		const auto total_output = this->stream.total_out;
+
+		// Switching levels flushes what was compressed at the previous one,
+		// which needs room; without enough, it is tried again on next call
+		if ( ( this->next_level != this->level ) &&
+			 ( ::deflateParams( &this->stream, this->next_level, Z_DEFAULT_STRATEGY ) == Z_OK ) )
+		{
+			this->level = this->next_level;
+		}
+
+		const auto result = ::deflate( &this->stream, finish ? Z_FINISH : Z_NO_FLUSH );
+
+		if ( ( result != Z_OK ) && ( result != Z_STREAM_END ) && ( result != Z_BUF_ERROR ) )
+		{
+			return -1;
+		}
+
+		this->finished = ( result == Z_STREAM_END );
+		this->window_input += this->stream.total_in - total_input;
+		this->window_output += this->stream.total_out - total_output;
+
+		if ( this->window_input >= LEVEL_WINDOW )
+		{
+			this->adapt_level();
+		}
+
+		return static_cast< int >( output_size - this->stream.avail_out );
+	}
+
+	// Decompresses input into the output buffer.
+	// Returns the number of bytes produced, or -1 if the data is corrupt.
+	int
+	deflate_stream::decompress(
+		void* output,
+		std::size_t output_size ) noexcept
+	{
+		if ( !this->valid || this->compressing )
+		{
+			return -1;
+		}
+
+		if ( this->finished )
+		{
+			return 0;
+		}
+
+		this->stream.next_out = static_cast< Bytef* >( output );
+		this->stream.avail_out = static_cast< uInt >( output_size );
+
+		const auto result = ::inflate( &this->stream, Z_NO_FLUSH );
+
+		if ( ( result != Z_OK ) && ( result != Z_STREAM_END ) && ( result != Z_BUF_ERROR ) )
+		{
+			return -1;
+		}
+
+		this->finished = ( result == Z_STREAM_END );
+
+		return static_cast< int >( output_size - this->stream.avail_out );
+	}
+
+	// Whether the whole stream was produced or decompressed
+	bool
+	deflate_stream::is_finished() const noexcept
+	{
+		return this->finished;
+	}
+
+	int
+	deflate_stream::get_level() const noexcept
+	{
+		return this->level;
+	}
+
+	// Picks the level of the next window from how much the last one shrank:
+	// poorly compressing data steps down to the fast level, then to storing
+	// (level 0), and data compressing well again steps back up
+	void
+	deflate_stream::adapt_level() noexcept
+	{
+		const auto ratio = this->window_output * 100 / std::max< std::uint64_t >( this->window_input, 1 );
+
+		switch ( this->level )
+		{
+		case Z_NO_COMPRESSION:
+			// Stored data tells nothing; compression is tried again
+			// after a while
+			if ( ++this->stored_windows >= STORED_WINDOW_COUNT )
+			{
+				this->stored_windows = 0;
+				this->next_level = FAST_LEVEL;
+			}
+			break;
+
+		case FAST_LEVEL:
+			if ( ratio > POOR_RATIO )
+			{
+				this->next_level = Z_NO_COMPRESSION;
+			}
+			else if ( ratio < GOOD_RATIO )
+			{
+				this->next_level = DEFAULT_LEVEL;
+			}
+			break;
+
+		default:
+			if ( ratio > POOR_RATIO )
+			{
+				this->next_level = FAST_LEVEL;
+			}
+			break;
+		}
+
+		this->window_input = 0;
+		this->window_output = 0;
+	}
+}
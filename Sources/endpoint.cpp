@@ -0,0 +1,82 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "endpoint.hpp"
+
+#ifdef __linux__
+	#include <arpa/inet.h>
+#endif
+
+namespace networking
+{
+	bool
+	endpoint::is_valid() const noexcept
+	{
+		return ( this->address_length > 0 );
+	}
+
+	int
+	endpoint::get_family() const noexcept
+	{
+		return this->address.ss_family;
+	}
+
+	std::uint16_t
+	endpoint::get_port() const noexcept
+	{
+		switch ( this->get_family() )
+		{
+		case AF_INET:
+			return ntohs( reinterpret_cast< sockaddr_in const * >( &this->address )->sin_port );
+
+		case AF_INET6:
+			return ntohs( reinterpret_cast< sockaddr_in6 const * >( &this->address )->sin6_port );
+
+		default:
+			return 0;
+		}
+	}
+
+	void
+	endpoint::set_port( std::uint16_t port ) noexcept
+	{
+		switch ( this->get_family() )
+		{
+		case AF_INET:
+			reinterpret_cast< sockaddr_in* >( &this->address )->sin_port = htons( port );
+			break;
+
+		case AF_INET6:
+			reinterpret_cast< sockaddr_in6* >( &this->address )->sin6_port = htons( port );
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// Formats the address without its port
+	std::string
+	endpoint::to_string() const
+	{
+		char text[INET6_ADDRSTRLEN] = {};
+
+		switch ( this->get_family() )
+		{
+		case AF_INET:
+			::inet_ntop( AF_INET, &reinterpret_cast< sockaddr_in const * >( &this->address )->sin_addr, text, sizeof( text ) );
+			break;
+
+		case AF_INET6:
+			::inet_ntop( AF_INET6, &reinterpret_cast< sockaddr_in6 const * >( &this->address )->sin6_addr, text, sizeof( text ) );
+			break;
+
+		default:
+			break;
+		}
+
+		return text;
+	}
+}
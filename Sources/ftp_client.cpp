@@ -4,31 +4,45 @@
  */
 
 #include "ftp_processor.hpp"
+#include "transfer_scheduler.hpp"
 
+#include <csignal>
 #include <iostream>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #ifdef __linux__
+	#include <signal.h>
 	#include <unistd.h>
 #elif _WIN32
 	#include <Windows.h>
 	#include <lmcons.h>
 #endif
 
+// Reads a command line; every parameter is also added to "params",
+// if given, for commands taking a list
 bool
 get_command(
 	std::string& command,
 	std::string& param1,
-	std::string& param2)
+	std::string& param2,
+	std::vector< std::string >* params = nullptr )
 {
 	command.clear();
 	param1.clear();
 	param2.clear();
 
+	if ( params != nullptr )
+	{
+		params->clear();
+	}
+
 	std::string line;
 	std::getline( std::cin, line );
 
+	auto index = 0;
 	while ( !line.empty() )
 	{
 		// Remove starting white spaces
@@ -41,7 +55,11 @@ get_command(
 
 		command_position = line.find_first_of(" \t");
 
-		auto index = 0;
+		if ( ( index > 0 ) && ( params != nullptr ) && ( command_position != 0 ) )
+		{
+			params->push_back( line.substr( 0, command_position ) );
+		}
+
 		switch (index++)
 		{
 		case 0:
@@ -57,7 +75,10 @@ get_command(
 			break;
 
 		default:
-			line.clear();
+			if ( params == nullptr )
+			{
+				line.clear();
+			}
 		}
 
 		if ( command_position == std::string::npos)
@@ -73,6 +94,27 @@ get_command(
 	return !command.empty();
 }
 
+// Session whose transfer is cancelled by an interrupt (Ctrl+C), and the
+// batch of transfers running on it and on further sessions, if any
+networking::ftp_processor* interrupted_session = nullptr;
+networking::transfer_scheduler* interrupted_batch = nullptr;
+
+// Cancels the transfer, or the batch of transfers, in progress; without
+// one, the interrupt ends the client as it did by default
+void
+interrupt_handler( int signal_number )
+{
+	const bool cancelled = ( interrupted_batch != nullptr ) ?
+		interrupted_batch->cancel() :
+		( ( interrupted_session != nullptr ) && interrupted_session->cancel_transfer() );
+
+	if ( !cancelled )
+	{
+		std::signal( signal_number, SIG_DFL );
+		std::raise( signal_number );
+	}
+}
+
 int
 main(
 	int argc,
@@ -80,8 +122,44 @@ main(
 {
 	networking::ftp_processor ftp_processor;
 
+	interrupted_session = &ftp_processor;
+
+	// Display the replies of the server
+	ftp_processor.set_reply_handler( []( networking::reply_view const & reply )
+	{
+		std::cout << reply.text;
+	} );
+
+	// Display the directory listings
+	ftp_processor.set_listing_handler( []( std::string_view data )
+	{
+		std::cout << data;
+	} );
+
+#ifdef __linux__
+	// Calls interrupted by the signal resume, except on the data
+	// connection, which the cancellation shuts down
+	struct sigaction interrupt_action = {};
+	interrupt_action.sa_handler = interrupt_handler;
+	interrupt_action.sa_flags = SA_RESTART;
+	sigemptyset( &interrupt_action.sa_mask );
+	::sigaction( SIGINT, &interrupt_action, nullptr );
+
+	// A cancelled upload fails with an error instead
+	std::signal( SIGPIPE, SIG_IGN );
+#elif _WIN32
+	std::signal( SIGINT, interrupt_handler );
+#endif
+
 	bool run = true;
 
+	// Login commands go out as one burst to servers tolerating it
+	if ( ( argc > 1 ) && ( std::string( argv[argc - 1] ) == "--fast-login" ) )
+	{
+		ftp_processor.set_fast_login( true );
+		--argc;
+	}
+
 	switch (argc)
 	{
 	case 0:
@@ -101,6 +179,10 @@ main(
 	std::string command;
 	std::string param1;
 	std::string param2;
+	std::vector< std::string > params;
+
+	// Sessions used by mget and mput
+	std::size_t session_count = 4;
 
 	// Connect
 	while ( run && !ftp_processor.is_connected() )
@@ -129,7 +211,8 @@ main(
 	while ( run )
 	{
 #ifdef __linux__
-		std::string username( getlogin( ) );
+		const auto* login = getlogin();
+		std::string username( login != nullptr ? login : "" );
 #elif _WIN32
 		char username[UNLEN + 1];
 		DWORD username_length = UNLEN + 1;
@@ -141,6 +224,20 @@ main(
 		{
 			run = false;
 		}
+		else if ( ftp_processor.is_fast_login() )
+		{
+			const auto name = command;
+
+			std::cout << "Password: ";
+			if ( !get_command( command, param1, param2 ) )
+			{
+				run = false;
+			}
+			else if ( ftp_processor.login( name, command ) )
+			{
+				break;
+			}
+		}
 		else if ( ftp_processor.send_user_name( command ) )
 		{
 			std::cout << "Password: ";
@@ -150,8 +247,6 @@ main(
 			}
 			else if ( ftp_processor.send_user_password( command ) )
 			{
-				ftp_processor.show_os();
-
 				break;
 			}
 		}
@@ -162,7 +257,7 @@ main(
 	{
 		std::cout << "ftp> ";
 
-		if ( !get_command( command, param1, param2 ) )
+		if ( !get_command( command, param1, param2, &params ) )
 		{
 			continue;
 		}
@@ -173,63 +268,157 @@ main(
 		{
 			if ( !param1.empty() )
 			{
-				success = ftp_processor.set_directory( param1 );
+				success = ftp_processor.set_directory( param1 ).is_positive();
 			}
 		}
 		else if ( command.compare("ls") == 0 )
 		{
 			success = ftp_processor.list_directories();
+
+			std::cout << std::endl;
 		}
 		else if ( command.compare("ldname") == 0 )
 		{
 			success = ftp_processor.list_directory_name();
+
+			std::cout << std::endl;
 		}
 		else if ( command.compare("currentdir") == 0 )
 		{
-			success = ftp_processor.get_directory();
+			success = ftp_processor.get_directory().is_positive();
 		}
 		else if ( command.compare("cdup") == 0 )
 		{
-			success = ftp_processor.set_directory_to_parent();
+			success = ftp_processor.set_directory_to_parent().is_positive();
 		}
 		else if ( command.compare("removedir") == 0 )
 		{
 			if ( !param1.empty() )
 			{
-				success = ftp_processor.remove_directory(param1);
+				success = ftp_processor.remove_directory(param1).is_positive();
 			}
 		}
 		else if ( command.compare("makedir") == 0 )
 		{
 			if ( !param1.empty() )
 			{
-				success = ftp_processor.make_directory(param1);
+				success = ftp_processor.make_directory(param1).is_positive();
 			}
 		}
 		else if ( command.compare("reinitialize") == 0 )
 		{
-			success = ftp_processor.reinitialize();
+			success = ftp_processor.reinitialize().is_positive();
 		}
 		else if ( command.compare("status") == 0 )
 		{
-			success = ftp_processor.status();
+			success = ftp_processor.status().is_positive();
 		}
 		else if ( command.compare("del") == 0 )
 		{
 			if ( !param1.empty() )
 			{
-				success = ftp_processor.delete_file(param1);
+				success = ftp_processor.delete_file(param1).is_positive();
+			}
+		}
+		else if ( command.compare("mdel") == 0 )
+		{
+			if ( !params.empty() )
+			{
+				std::vector< std::string > failed;
+
+				success = ftp_processor.delete_files( params, failed );
+
+				for ( auto const & filename : failed )
+				{
+					std::cout << filename << " not deleted" << std::endl;
+				}
 			}
 		}
 		else if ( command.compare("sys") == 0 )
 		{
-			success = ftp_processor.show_os();
+			success = ftp_processor.show_os().is_positive();
 		}
 		else if ( command.compare("get") == 0 )
 		{
 			if ( !param1.empty() )
 			{
 				success = ftp_processor.get_file(param1);
+
+				if ( success )
+				{
+					std::cout << ftp_processor.get_transferred_bytes() << " bytes received" << std::endl;
+				}
+			}
+		}
+		else if ( command.compare("sget") == 0 )
+		{
+			if ( !param1.empty() )
+			{
+				// Number of sessions, 4 by default
+				const auto sessions = param2.empty() ? 4 : std::atoi( param2.c_str() );
+
+				if ( sessions > 0 )
+				{
+					success = ftp_processor.get_file_segmented( param1, static_cast< std::size_t >( sessions ) );
+
+					if ( success )
+					{
+						std::cout << ftp_processor.get_transferred_bytes() << " bytes received" << std::endl;
+					}
+				}
+			}
+		}
+		else if ( command.compare("sput") == 0 )
+		{
+			if ( !param1.empty() )
+			{
+				// Number of sessions, 4 by default
+				const auto sessions = param2.empty() ? 4 : std::atoi( param2.c_str() );
+
+				if ( sessions > 0 )
+				{
+					success = ftp_processor.put_file_segmented( param1, static_cast< std::size_t >( sessions ) );
+
+					if ( success )
+					{
+						std::cout << ftp_processor.get_transferred_bytes() << " bytes sent" << std::endl;
+					}
+				}
+			}
+		}
+		else if ( ( command.compare("mget") == 0 ) || ( command.compare("mput") == 0 ) )
+		{
+			if ( !params.empty() )
+			{
+				networking::transfer_scheduler scheduler( ftp_processor, session_count );
+
+				interrupted_batch = &scheduler;
+
+				success = ( command.compare("mget") == 0 ) ? scheduler.get_files( params ) : scheduler.put_files( params );
+
+				interrupted_batch = nullptr;
+
+				std::cout << scheduler.get_transferred_files() << " files transferred" << std::endl;
+
+				for ( auto const & pattern : scheduler.get_unmatched_patterns() )
+				{
+					std::cout << pattern << ": no match" << std::endl;
+				}
+
+				for ( auto const & filename : scheduler.get_failed_files() )
+				{
+					std::cout << filename << " failed" << std::endl;
+				}
+			}
+		}
+		else if ( command.compare("sessions") == 0 )
+		{
+			const auto sessions = std::atoi( param1.c_str() );
+
+			if ( sessions > 0 )
+			{
+				session_count = static_cast< std::size_t >( sessions );
+				success = true;
 			}
 		}
 		else if ( command.compare("put") == 0 )
@@ -237,6 +426,11 @@ main(
 			if ( !param1.empty() )
 			{
 				success = ftp_processor.put_file(param1);
+
+				if ( success )
+				{
+					std::cout << ftp_processor.get_transferred_bytes() << " bytes sent" << std::endl;
+				}
 			}
 		}
 		else if ( command.compare("type") == 0 )
@@ -253,6 +447,58 @@ main(
 				}
 			}
 		}
+		else if ( command.compare("engine") == 0 )
+		{
+			if ( param1 == "standard" )
+			{
+				success = ftp_processor.set_transfer_engine( networking::transfer_engine_kind::standard );
+			}
+			else if ( param1 == "uring" )
+			{
+				success = ftp_processor.set_transfer_engine( networking::transfer_engine_kind::io_uring );
+			}
+		}
+		else if ( command.compare("mode") == 0 )
+		{
+			if ( param1 == "block" )
+			{
+				success = ftp_processor.set_block_mode( true );
+			}
+			else if ( param1 == "compressed" )
+			{
+				success = ftp_processor.set_compressed_mode( true );
+			}
+			else if ( param1 == "stream" )
+			{
+				success = ftp_processor.set_block_mode( false );
+			}
+		}
+		else if ( command.compare("prefetch") == 0 )
+		{
+			if ( param1 == "on" )
+			{
+				ftp_processor.set_pasv_prefetch( true );
+				success = true;
+			}
+			else if ( param1 == "off" )
+			{
+				ftp_processor.set_pasv_prefetch( false );
+				success = true;
+			}
+		}
+		else if ( command.compare("resume") == 0 )
+		{
+			if ( param1 == "on" )
+			{
+				ftp_processor.set_resumable( true );
+				success = true;
+			}
+			else if ( param1 == "off" )
+			{
+				ftp_processor.set_resumable( false );
+				success = true;
+			}
+		}
 		else if ( command.compare("close") == 0 )
 		{
 			ftp_processor.terminate();
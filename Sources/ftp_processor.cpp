@@ -4,15 +4,260 @@
  */
 
 #include "ftp_processor.hpp"
+#include "segmented_transfer.hpp"
+#include "transfer_checkpoint.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <stdlib.h>
-#include <sstream>
 #include <fstream>
+#include <utility>
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
 
 namespace networking
 {
+	// Extracts the transfer size servers commonly include in their
+	// 150 and 226 replies, as in "150 Opening BINARY mode data
+	// connection for file (1234 bytes)". Returns -1 if absent.
+	static std::int64_t
+	parse_transfer_size( char const * reply ) noexcept
+	{
+		for ( auto* position = std::strchr( reply, '(' ); position != nullptr; position = std::strchr( position + 1, '(' ) )
+		{
+			char* end = nullptr;
+			const auto size = std::strtoll( position + 1, &end, 10 );
+
+			if ( ( end != position + 1 ) && ( std::strncmp( end, " bytes", 6 ) == 0 ) && ( size >= 0 ) )
+			{
+				return size;
+			}
+		}
+
+		return -1;
+	}
+
+	// Extracts the size of a file from a reply to SIZE (RFC 3659).
+	// Returns -1 if the reply reports no size.
+	static std::int64_t
+	parse_file_size(
+		int code,
+		std::string_view reply ) noexcept
+	{
+		// Expected SIZE command reply
+		static constexpr auto FILE_STATUS_OK = 213;
+
+		std::int64_t size = -1;
+
+		if ( ( code == FILE_STATUS_OK ) && ( reply.size() > 4 ) )
+		{
+			std::from_chars( reply.data() + 4, reply.data() + reply.size(), size );
+		}
+
+		return size;
+	}
+
+	// Returns the number of days from 1970-01-01 to a date of the proleptic
+	// Gregorian calendar
+	static std::int64_t
+	days_from_civil(
+		int year,
+		unsigned month,
+		unsigned day ) noexcept
+	{
+		// Years start in March, so that the leap day ends them
+		year -= ( month <= 2 ) ? 1 : 0;
+
+		const std::int64_t era = ( ( year >= 0 ) ? year : year - 399 ) / 400;
+		const auto year_of_era = static_cast< unsigned >( year - era * 400 );
+		const auto day_of_year = ( 153 * ( ( month > 2 ) ? month - 3 : month + 9 ) + 2 ) / 5 + day - 1;
+		const auto day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+		return era * 146097 + static_cast< std::int64_t >( day_of_era ) - 719468;
+	}
+
+	// Parses a number of at most "digits" digits, up to "maximum", and moves
+	// past it; returns false if there is none or if it is too large
+	static bool
+	parse_number(
+		char const *& position,
+		std::size_t digits,
+		unsigned maximum,
+		unsigned& value ) noexcept
+	{
+		value = 0;
+
+		std::size_t count = 0;
+
+		for ( ; ( count < digits ) && ( *position >= '0' ) && ( *position <= '9' ); ++count, ++position )
+		{
+			value = value * 10 + static_cast< unsigned >( *position - '0' );
+		}
+
+		return ( count > 0 ) && ( value <= maximum ) && !( ( *position >= '0' ) && ( *position <= '9' ) );
+	}
+
+	// Extracts the port of a 227 reply to PASV (RFC 959), given as the first
+	// "h1,h2,h3,h4,p1,p2" of the reply, with or without parentheses: six
+	// numbers from 0 to 255, the first four being the address.
+	// Text around the numbers is ignored.
+	static bool
+	parse_passive_port(
+		char const * reply,
+		std::uint16_t& port ) noexcept
+	{
+		static constexpr std::size_t NUMBER_COUNT = 6;
+
+		// Past the reply code
+		for ( auto* position = reply + std::min< std::size_t >( std::strlen( reply ), 4 ); *position != '\0'; ++position )
+		{
+			if ( ( *position < '0' ) || ( *position > '9' ) )
+			{
+				continue;
+			}
+
+			std::array< unsigned, NUMBER_COUNT > numbers;
+			auto* number = position;
+			std::size_t count = 0;
+
+			while ( ( count < NUMBER_COUNT ) && parse_number( number, 3, 255, numbers[count] ) )
+			{
+				if ( ( ++count < NUMBER_COUNT ) && ( *number++ != ',' ) )
+				{
+					break;
+				}
+			}
+
+			if ( count == NUMBER_COUNT )
+			{
+				port = static_cast< std::uint16_t >( ( numbers[4] << 8 ) | numbers[5] );
+
+				return port != 0;
+			}
+
+			// Skip the rest of a number that did not start the sequence
+			while ( ( position[1] >= '0' ) && ( position[1] <= '9' ) )
+			{
+				++position;
+			}
+		}
+
+		return false;
+	}
+
+	// Extracts the port of a 229 reply to EPSV (RFC 2428), given as
+	// "(<d><d><d>port<d>)" where <d> is a delimiter, usually "|"
+	static bool
+	parse_extended_passive_port(
+		char const * reply,
+		std::uint16_t& port ) noexcept
+	{
+		auto* position = std::strchr( reply, '(' );
+
+		if ( position == nullptr )
+		{
+			return false;
+		}
+
+		// Any printable character but a digit may delimit
+		const auto delimiter = position[1];
+
+		if ( ( delimiter < 33 ) || ( delimiter > 126 ) || ( ( delimiter >= '0' ) && ( delimiter <= '9' ) ) ||
+			 ( position[2] != delimiter ) || ( position[3] != delimiter ) )
+		{
+			return false;
+		}
+
+		position += 4;
+
+		unsigned value = 0;
+
+		if ( !parse_number( position, 5, 65535, value ) || ( value == 0 ) ||
+			 ( position[0] != delimiter ) || ( position[1] != ')' ) )
+		{
+			return false;
+		}
+
+		port = static_cast< std::uint16_t >( value );
+
+		return true;
+	}
+
+	// Identifies a server by host and port, as several servers may share a host
+	using server_key = std::pair< std::string, std::uint16_t >;
+
+	// Servers that replied unexpectedly to a fast login, shared by all sessions
+	static std::mutex fast_login_mutex;
+	static std::set< server_key > fast_login_refusals;
+
+	static bool
+	is_fast_login_refused(
+		std::string const & host,
+		std::uint16_t port )
+	{
+		std::lock_guard< std::mutex > lock( fast_login_mutex );
+
+		return fast_login_refusals.count( server_key( host, port ) ) != 0;
+	}
+
+	static void
+	refuse_fast_login(
+		std::string const & host,
+		std::uint16_t port )
+	{
+		std::lock_guard< std::mutex > lock( fast_login_mutex );
+
+		fast_login_refusals.emplace( host, port );
+	}
+
+	// Servers that refused EPSV but accepted PASV, shared by all sessions
+	static std::mutex extended_passive_mutex;
+	static std::set< server_key > extended_passive_refusals;
+
+	static bool
+	is_extended_passive_refused(
+		std::string const & host,
+		std::uint16_t port )
+	{
+		std::lock_guard< std::mutex > lock( extended_passive_mutex );
+
+		return extended_passive_refusals.count( server_key( host, port ) ) != 0;
+	}
+
+	// Records which command gave a passive port, to be used first from then on
+	static void
+	set_extended_passive_refused(
+		std::string const & host,
+		std::uint16_t port,
+		bool refused )
+	{
+		std::lock_guard< std::mutex > lock( extended_passive_mutex );
+
+		if ( refused )
+		{
+			extended_passive_refusals.emplace( host, port );
+		}
+		else
+		{
+			extended_passive_refusals.erase( server_key( host, port ) );
+		}
+	}
+
+	// Constructor; commands are latency-bound while transfers are throughput-bound
+	ftp_processor::ftp_processor()
+	{
+		this->command_socket.set_profile( socket_profile::control() );
+	}
+
 	// Destructor
 	ftp_processor::~ftp_processor() noexcept
 	{
@@ -43,26 +288,95 @@ namespace networking
 			 !this->is_data_connected() &&
 			 this->host_address.empty() )
 		{
-			this->command_socket.close();
+			const auto endpoints = this->name_resolver->resolve( host, ( port == 0 ) ? socket::DEFAULT_PORT : port );
 
-			if ( this->command_socket.connect_client_socket( host, port ) )
+			if ( !this->connect_endpoints( host, endpoints ) )
 			{
-				// Expected connection reply
-				static constexpr auto CONNECTED_OK = 220;
+				return false;
+			}
 
-				if ( this->receive_reply() && std::atoi( message.data() ) == CONNECTED_OK )
-				{
-					// Memorize the host address for subsequent data connection
-					this->host_address = host;
+			// A server seen before needs no FEAT
+			this->capabilities_known = capability_cache( this->capability_cache_path ).find(
+				this->host_address, this->server_endpoint.get_port(), this->server_banner, this->capabilities );
 
-					return true;
-				}
+			return true;
+		}
+
+		return ( false );
+	}
+
+	// Opens another session on the server of the origin session, logged in
+	// with the same credentials, without resolving the host again.
+	// The session then moves to the given directory, if any, and transfers
+	// files through the same engine, checkpoints and mode as the origin session.
+	bool
+	ftp_processor::connect_session(
+		ftp_processor const & origin,
+		std::string const & directory )
+	{
+		if ( !this->is_connected() &&
+			 !this->is_data_connected() &&
+			 this->host_address.empty() &&
+			 origin.server_endpoint.is_valid() )
+		{
+			this->name_resolver = origin.name_resolver;
+			this->capability_cache_path = origin.capability_cache_path;
+			this->resumable = origin.resumable;
+			this->fast_login = origin.fast_login;
+			this->set_transfer_engine( origin.get_transfer_engine() );
+
+			const auto block_mode = origin.block_mode;
+			const auto compressed_mode = origin.compressed_mode;
+
+			if ( this->connect_endpoints( origin.host_address, { origin.server_endpoint } ) &&
+				 this->login( origin.user_name, origin.user_password, directory ) )
+			{
+				// Same server, same features
+				this->features = origin.features;
+				this->features_known = origin.features_known;
+				this->capabilities = origin.capabilities;
+				this->capabilities_known = origin.capabilities_known;
+
+				return ( !block_mode || this->set_block_mode( true ) ) &&
+					( !compressed_mode || this->set_compressed_mode( true ) );
 			}
+		}
+
+		return false;
+	}
+
+	// Connects the command socket to the first reachable endpoint and
+	// waits for the server greeting
+	bool
+	ftp_processor::connect_endpoints(
+		std::string const & host,
+		std::vector< endpoint > const & endpoints )
+	{
+		this->detach();
+		this->command_socket.close();
+
+		if ( this->command_socket.connect_client_socket( endpoints ) )
+		{
+			// Expected connection reply
+			static constexpr auto CONNECTED_OK = 220;
+
+			if ( this->receive_reply().code == CONNECTED_OK )
+			{
+				// Memorize the host address and the address actually
+				// connected to, so that data connections need no lookup
+				this->host_address = host;
+				this->server_endpoint = this->command_socket.get_peer_endpoint();
+				this->server_banner = std::string( this->get_reply().text );
+
+				this->data_socket_pool.fill( this->server_endpoint.get_family() );
 
-			this->disconnect( true );
+				return true;
+			}
 		}
 
-		return ( false );
+		this->disconnect( true );
+
+		return false;
 	}
 
 	// this->disconnects and destroys the command and the data sockets.
@@ -71,6 +385,11 @@ namespace networking
 	void
 	ftp_processor::disconnect( bool full )
 	{
+		if ( full )
+		{
+			this->detach();
+		}
+
 		this->stop_data_connection( true );
 
 		if ( full )
@@ -81,201 +400,518 @@ namespace networking
 	}
 
 	// Sends an FTP command with or without parameters to the FTP server.
-	// It checks the response and returns true if successful.
-	bool
+	// Returns its reply, which converts to true if the command succeeded,
+	// or a reply without code if it could not be sent or had no reply.
+	reply_view
 	ftp_processor::ftp_command(
-		const std::string command,
-		const std::string parameter )
+		std::string_view command,
+		std::string_view parameter )
 	{
-		if ( this->is_connected() )
-		{
-			std::fill( std::begin( this->message ), std::end( this->message ), 0 );
-
-			std::stringstream formatter;
-			formatter << command;
+		this->encoder.clear();
 
-			if ( !parameter.empty() )
-			{
-				formatter << " " << parameter;
-			}
-
-			formatter << std::endl;
-
-			const auto formatted_message = formatter.str();
-
-			std::copy(
-				std::begin( formatted_message ),
-				std::end( formatted_message ),
-				std::begin( this->message ) );
-
-			return this->send_command();
+		if ( !this->is_connected() || !this->encoder.append( command, parameter ) )
+		{
+			return {};
 		}
 
-		return false;
+		return this->send_encoded_commands();
 	}
 
-	// Terminates all connections and optionally, quits FTP. 
-	void
-	ftp_processor::terminate()
+	reply_view
+	ftp_processor::ftp_command(
+		ftp_verb command,
+		std::string_view parameter )
 	{
-		this->ftp_command( "QUIT", "" );
-		this->disconnect( true );
-	}
+		this->encoder.clear();
 
-	// Sets the type of the transfer to Binary or ASCII (TYPE command) 
-	bool
-	ftp_processor::set_transfer_type( bool type )
-	{
-		if ( this->ftp_command( "TYPE", ( type ? "A" : "I" ) ) )
+		if ( !this->is_connected() || !this->encoder.append( command, parameter ) )
 		{
-			this->transfer_type = type;
-
-			return true;
+			return {};
 		}
 
-		return false;
+		return this->send_encoded_commands();
 	}
 
-	// Sends the user name to the FTP server (USER command)
-	bool
-	ftp_processor::send_user_name( std::string const & name )
+	// Sends a command with a number as its parameter, such as an offset
+	reply_view
+	ftp_processor::ftp_command(
+		ftp_verb command,
+		std::int64_t parameter )
 	{
-		// Expected USER command reply
-		static constexpr auto USERNAME_OK = 331;
+		std::array< char, 24 > digits;
 
-		return this->ftp_command( "USER", name ) && ( atoi( this->message.data() ) == USERNAME_OK );
-	}
+		const auto result = std::to_chars( digits.data(), digits.data() + digits.size(), parameter );
 
-	// Sends the user password to the FTP server (PASS command)
-	bool
-	ftp_processor::send_user_password( std::string const & password )
-	{
-		return this->ftp_command( "PASS", password ) && this->receive_reply();
+		return this->ftp_command( command, std::string_view( digits.data(), static_cast< std::size_t >( result.ptr - digits.data() ) ) );
 	}
 
-	// Displays the operating system (SYST command)
-	bool
-	ftp_processor::show_os()
+	// Sends the command lines of the encoder, in a single send, and
+	// retrieves the reply to the first one
+	reply_view
+	ftp_processor::send_encoded_commands()
 	{
-		return this->ftp_command( "SYST", "" );
+		auto buffer = make_buffer( this->encoder.data(), this->encoder.size() );
+
+		return this->send_command( &buffer, 1 );
 	}
 
-	// Retrieves the content of the present working directory (LIST command) 
+	// Sends commands without waiting for the reply of each before the next,
+	// keeping up to "window" of them in flight, and stores the final reply
+	// of each one in it. Commands must not open a data connection.
+	// Returns true if every command succeeded; otherwise the failed commands
+	// are the ones whose reply reports a failure or that got no reply.
 	bool
-	ftp_processor::list_directories()
+	ftp_processor::pipeline_commands(
+		std::vector< pipelined_command >& commands,
+		std::size_t window )
 	{
-		if ( this->start_data_connection( "LIST", nullptr ) )
+		window = std::max< std::size_t >( window, 1 );
+
+		std::size_t sent = 0;
+		std::size_t replied = 0;
+
+		while ( ( replied < commands.size() ) && this->is_connected() )
 		{
-			std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+			// Fill the window, or the encoder, with a single write
+			this->encoder.clear();
+
+			for ( ; ( sent < commands.size() ) && ( sent - replied < window ); ++sent )
+			{
+				if ( !this->encoder.append( commands[sent].command, commands[sent].parameter ) )
+				{
+					break;
+				}
+			}
+
+			auto buffer = make_buffer( this->encoder.data(), this->encoder.size() );
 
-			while ( this->data_socket.receive_message( static_cast<void *>( this->message.data() ), strlen( this->message.data() ) - 1 ) != 0 )
+			if ( !this->encoder.empty() && !this->send_command_buffers( &buffer, 1 ) )
 			{
-				// Retrieves the directory content and displays it on the console
-				std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+				// Partially written commands cannot be attributed
+				break;
+			}
 
-				// Display the data retrieved
-				std::cout << this->message.data();
+			// A command that cannot be encoded gets no reply
+			if ( replied == sent )
+			{
+				break;
 			}
 
-			std::cout << std::endl;
+			// Preliminary replies (1xx) are followed by the final one
+			auto& current = commands[replied];
 
-			this->stop_data_connection( false );
+			reply_view reply;
 
-			return true;
+			do
+			{
+				// Left without code if the connection ends before the reply
+				reply = this->receive_reply();
+			}
+			while ( reply.is_preliminary() && this->is_connected() );
+
+			current.reply_code = reply.code;
+			current.reply = reply.text;
+
+			if ( current.reply_code == 0 )
+			{
+				break;
+			}
+
+			++replied;
 		}
 
-		return false;
+		return std::all_of( commands.begin(), commands.end(), []( pipelined_command const & command )
+		{
+			return command.succeeded();
+		} );
 	}
 
-	// Retrieves only the names of the present working directory (NLST command) 
+	// Deletes files with pipelined DELE commands, reporting those that
+	// could not be deleted
 	bool
-	ftp_processor::list_directory_name()
+	ftp_processor::delete_files(
+		std::vector< std::string > const & filenames,
+		std::vector< std::string >& failed_filenames )
 	{
-		if ( this->start_data_connection( "NLST", "" ) )
-		{
-			std::fill( std::begin( this->message ), std::end( this->message ), 0 );
-
-			while ( this->data_socket.receive_message( static_cast< void* >( this->message.data() ), strlen( this->message.data() ) - 1 ) != 0 )
-			{
-				// Retrieves the directory content and displays it on the console
-				std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+		std::vector< pipelined_command > commands;
 
-				// Display the data retrieved
-				std::cout << this->message.data();
-			}
+		for ( auto const & filename : filenames )
+		{
+			pipelined_command command;
+			command.command = "DELE";
+			command.parameter = filename;
 
-			std::cout << std::endl;
+			commands.push_back( command );
+		}
 
-			this->stop_data_connection( false );
+		failed_filenames.clear();
 
+		if ( this->pipeline_commands( commands ) )
+		{
 			return true;
 		}
 
+		for ( auto const & command : commands )
+		{
+			if ( !command.succeeded() )
+			{
+				failed_filenames.push_back( command.parameter );
+			}
+		}
+
 		return false;
 	}
 
-	// Retrieves the present working directory (PWD command) 
+	// Checks whether the reply reports a success
 	bool
-	ftp_processor::get_directory()
+	pipelined_command::succeeded() const noexcept
 	{
-		return this->ftp_command( "PWD", "" );
-	}
+		// FTP Error Threshold
+		static constexpr auto error_threshold = 400;
 
-	// Changes the current directory on the the FTP server (CWD command) 
-	bool
-	ftp_processor::set_directory( std::string const & directory )
-	{
-		return this->ftp_command( "CWD", directory );
+		return ( this->reply_code > 0 ) && ( this->reply_code < error_threshold );
 	}
 
-	// Changes the current directory to the parent directory (CDUP command)
-	bool
-	ftp_processor::set_directory_to_parent()
+	// Terminates all connections and optionally, quits FTP. 
+	void
+	ftp_processor::terminate()
 	{
-		return this->ftp_command( "CDUP", "" );
+		this->ftp_command( ftp_verb::QUIT );
+		this->disconnect( true );
 	}
 
-	// Removes the selected directory on the FTP server (RMD command)
-	// This functions doesn’t support recursive deletion (if the folder has files in it),
-	// and will fail if the folder is not empty.
+	// Sets the type of the transfer to Binary or ASCII (TYPE command) 
 	bool
-	ftp_processor::remove_directory( std::string const & directory )
+	ftp_processor::set_transfer_type( bool type )
 	{
-		return this->ftp_command( "RMD", directory );
+		if ( this->ftp_command( ftp_verb::TYPE, ( type ? "A" : "I" ) ) )
+		{
+			this->transfer_type = type;
+
+			return true;
+		}
+
+		return false;
 	}
 
-	// Makes a directory on the server (MKD command)
+	// Logs in (USER and PASS commands), then sets the transfer type (TYPE
+	// command) and moves to the given directory, if any (CWD command).
+	// With fast login, the four commands go out in a single pipelined burst.
+	// A server that loses commands of the burst, or handles them as if the
+	// login had not completed, is no longer sent bursts; the login then
+	// resumes one command at a time from the first step not completed, on a
+	// new connection if the server dropped this one. Other failures, such as
+	// a wrong password, are those of the login itself.
 	bool
-	ftp_processor::make_directory( std::string const & directory )
+	ftp_processor::login(
+		std::string const & name,
+		std::string const & password,
+		std::string const & directory )
 	{
-		return this->ftp_command( "MKD", directory );
-	}
+		// Expected replies
+		static constexpr auto USERNAME_OK = 331;
+		static constexpr auto LOGGED_IN = 230;
+		static constexpr auto NOT_IMPLEMENTED = 202;
+		static constexpr auto BAD_SEQUENCE = 503;
+		static constexpr auto NOT_LOGGED_IN = 530;
 
-	// Terminate the USER session and purge all account information (REIN command)
+		// Steps completed: USER, PASS (or none needed), TYPE, then CWD
+		std::size_t completed_steps = 0;
+
+		if ( this->fast_login && !is_fast_login_refused( this->host_address, this->server_endpoint.get_port() ) )
+		{
+			std::vector< pipelined_command > commands( directory.empty() ? 3 : 4 );
+
+			commands[0].command = "USER";
+			commands[0].parameter = name;
+			commands[1].command = "PASS";
+			commands[1].parameter = password;
+			commands[2].command = "TYPE";
+			commands[2].parameter = this->transfer_type ? "A" : "I";
+
+			if ( !directory.empty() )
+			{
+				commands[3].command = "CWD";
+				commands[3].parameter = directory;
+			}
+
+			this->pipeline_commands( commands, commands.size() );
+
+			// Servers without password reply 230 to USER, then 503 or 202 to PASS
+			const auto user_code = commands[0].reply_code;
+			const auto password_code = commands[1].reply_code;
+			const bool logged_in = ( user_code == LOGGED_IN ) ||
+				( ( user_code == USERNAME_OK ) && ( ( password_code == LOGGED_IN ) || ( password_code == NOT_IMPLEMENTED ) ) );
+
+			if ( logged_in )
+			{
+				completed_steps = 2;
+
+				while ( ( completed_steps < commands.size() ) && commands[completed_steps].succeeded() )
+				{
+					++completed_steps;
+				}
+			}
+			else if ( user_code == USERNAME_OK )
+			{
+				completed_steps = 1;
+			}
+
+			// A reply missing, or refusing a command for lack of a login
+			// that succeeded, shows commands read before the login completed
+			bool mishandled = !this->is_connected();
+
+			for ( std::size_t idx = 0; idx < commands.size(); ++idx )
+			{
+				const auto code = commands[idx].reply_code;
+
+				mishandled = mishandled ||
+					( code == 0 ) ||
+					( ( idx == 1 ) && ( user_code == USERNAME_OK ) && ( code == BAD_SEQUENCE ) ) ||
+					( ( idx >= 2 ) && logged_in && ( ( code == NOT_LOGGED_IN ) || ( code == BAD_SEQUENCE ) ) );
+			}
+
+			if ( logged_in )
+			{
+				this->user_name = name;
+				this->user_password = password;
+			}
+
+			if ( !mishandled )
+			{
+				return completed_steps == commands.size();
+			}
+
+			refuse_fast_login( this->host_address, this->server_endpoint.get_port() );
+
+			if ( !this->is_connected() )
+			{
+				const auto host = this->host_address;
+				const auto peer = this->server_endpoint;
+
+				this->replies.clear();
+
+				if ( !peer.is_valid() || !this->connect_endpoints( host, { peer } ) )
+				{
+					return false;
+				}
+
+				completed_steps = 0;
+			}
+		}
+
+		if ( completed_steps == 0 )
+		{
+			const auto code = this->ftp_command( ftp_verb::USER, name ).code;
+
+			if ( ( code != USERNAME_OK ) && ( code != LOGGED_IN ) )
+			{
+				return false;
+			}
+
+			this->user_name = name;
+
+			if ( code == LOGGED_IN )
+			{
+				this->user_password = password;
+			}
+
+			completed_steps = ( code == LOGGED_IN ) ? 2 : 1;
+		}
+
+		return ( ( completed_steps > 1 ) || this->send_user_password( password ) ) &&
+			( ( completed_steps > 2 ) || this->set_transfer_type( this->transfer_type ) ) &&
+			( ( completed_steps > 3 ) || directory.empty() || this->set_directory( directory ) );
+	}
+
+	// Makes login send its commands as one pipelined burst. Only meant for
+	// servers known to read commands sent ahead of the login completion.
+	void
+	ftp_processor::set_fast_login( bool fast_login ) noexcept
+	{
+		this->fast_login = fast_login;
+	}
+
+	bool
+	ftp_processor::is_fast_login() const noexcept
+	{
+		return this->fast_login;
+	}
+
+	// Returns the type of the transfers; true for ASCII, false for binary
+	bool
+	ftp_processor::get_transfer_type() const noexcept
+	{
+		return this->transfer_type;
+	}
+
+	// Sends the user name to the FTP server (USER command)
+	bool
+	ftp_processor::send_user_name( std::string const & name )
+	{
+		// Expected USER command reply
+		static constexpr auto USERNAME_OK = 331;
+
+		if ( this->ftp_command( ftp_verb::USER, name ).code == USERNAME_OK )
+		{
+			// Kept for opening further sessions
+			this->user_name = name;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Sends the user password to the FTP server (PASS command)
+	bool
+	ftp_processor::send_user_password( std::string const & password )
+	{
+		if ( this->ftp_command( ftp_verb::PASS, password ) )
+		{
+			// Kept for opening further sessions
+			this->user_password = password;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Displays the operating system (SYST command)
+	reply_view
+	ftp_processor::show_os()
+	{
+		return this->ftp_command( ftp_verb::SYST );
+	}
+
+	// Retrieves the content of the present working directory (LIST command) 
+	bool
+	ftp_processor::list_directories()
+	{
+		if ( this->start_data_connection( ftp_verb::LIST ) )
+		{
+			auto bytes = 0;
+
+			while ( ( bytes = this->receive_data( static_cast< void* >( this->message.data() ), this->message.size() ) ) > 0 )
+			{
+				// Hand the data retrieved over as it arrives
+				if ( this->listing_listener )
+				{
+					this->listing_listener( std::string_view( this->message.data(), static_cast< std::size_t >( bytes ) ) );
+				}
+			}
+
+			// A listing cut off by a failed connection is incomplete
+			return this->stop_data_connection( false ) && ( bytes == 0 );
+		}
+
+		return false;
+	}
+
+	// Retrieves only the names of the present working directory (NLST command) 
 	bool
+	ftp_processor::list_directory_name()
+	{
+		if ( this->start_data_connection( ftp_verb::NLST ) )
+		{
+			auto bytes = 0;
+
+			while ( ( bytes = this->receive_data( static_cast< void* >( this->message.data() ), this->message.size() ) ) > 0 )
+			{
+				// Hand the data retrieved over as it arrives
+				if ( this->listing_listener )
+				{
+					this->listing_listener( std::string_view( this->message.data(), static_cast< std::size_t >( bytes ) ) );
+				}
+			}
+
+			// A listing cut off by a failed connection is incomplete
+			return this->stop_data_connection( false ) && ( bytes == 0 );
+		}
+
+		return false;
+	}
+
+	// Retrieves the present working directory (PWD command) 
+	reply_view
+	ftp_processor::get_directory()
+	{
+		return this->ftp_command( ftp_verb::PWD );
+	}
+
+	// Changes the current directory on the the FTP server (CWD command) 
+	reply_view
+	ftp_processor::set_directory( std::string const & directory )
+	{
+		return this->ftp_command( ftp_verb::CWD, directory );
+	}
+
+	// Changes the current directory to the parent directory (CDUP command)
+	reply_view
+	ftp_processor::set_directory_to_parent()
+	{
+		return this->ftp_command( ftp_verb::CDUP );
+	}
+
+	// Removes the selected directory on the FTP server (RMD command)
+	// This functions doesn’t support recursive deletion (if the folder has files in it),
+	// and will fail if the folder is not empty.
+	reply_view
+	ftp_processor::remove_directory( std::string const & directory )
+	{
+		return this->ftp_command( ftp_verb::RMD, directory );
+	}
+
+	// Makes a directory on the server (MKD command)
+	reply_view
+	ftp_processor::make_directory( std::string const & directory )
+	{
+		return this->ftp_command( ftp_verb::MKD, directory );
+	}
+
+	// Terminate the USER session and purge all account information (REIN command)
+	reply_view
 	ftp_processor::reinitialize()
 	{
-		return this->ftp_command( "REIN", "" );
+		return this->ftp_command( ftp_verb::REIN );
 	}
 
 	// Returns server status (STAT command)
-	bool
+	reply_view
 	ftp_processor::status()
 	{
-		return this->ftp_command( "STAT", "" );
+		return this->ftp_command( ftp_verb::STAT );
 	}
 
 	// Delete a file from the FTP server (DELE command)
-	bool
+	reply_view
 	ftp_processor::delete_file( std::string const & filename )
 	{
-		return this->ftp_command( "DELE", filename );
+		return this->ftp_command( ftp_verb::DELE, filename );
 	}
 
-	// Downloads a file from the FTP server (RETR command)
+	// Downloads a file from the FTP server (RETR command) into a local file
+	// of the same name
 	bool
 	ftp_processor::get_file( std::string const & filename )
 	{
+		return this->get_file( filename, filename );
+	}
+
+	// Downloads a file from the FTP server (RETR command) into the local file
+	bool
+	ftp_processor::get_file(
+		std::string const & filename,
+		std::string const & local_filename )
+	{
+	#ifdef __linux__
+		if ( !this->transfer_type )
+		{
+			return this->get_binary_file( filename, local_filename );
+		}
+	#endif
+
 		if ( this->is_connected() )
 		{
 			std::ios_base::openmode mode = std::ios_base::out;
@@ -285,32 +921,28 @@ namespace networking
 				mode |= std::ios_base::binary;
 			}
 
-			std::ofstream output( filename, mode );
+			std::ofstream output( local_filename, mode );
 
 			if ( output.is_open() )
 			{
 				this->set_transfer_type( this->transfer_type );
 
-				if ( this->start_data_connection( "RETR", filename ) )
+				if ( this->start_data_connection( ftp_verb::RETR, filename ) )
 				{
-					while ( true )
-					{
-						std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+					this->transferred_bytes = 0;
 
-						auto bytes = this->data_socket.receive_message( static_cast< void* >( this->message.data() ), strlen( this->message.data() ) );
+					auto bytes = 0;
 
-						if ( bytes == 0 )
-						{
-							break;
-						}
+					while ( ( bytes = this->receive_data( static_cast< void* >( this->message.data() ), this->message.size() ) ) > 0 )
+					{
 
 						// Get data from server and writes to the local file
-						output << this->message.data();
-					}
+						output.write( this->message.data(), bytes );
 
-					this->stop_data_connection( false );
+						this->transferred_bytes += bytes;
+					}
 
-					return true;
+					return this->stop_data_connection( false ) && ( bytes == 0 ) && output.good();
 				}
 			}
 		}
@@ -322,6 +954,13 @@ namespace networking
 	bool
 	ftp_processor::put_file( std::string const & filename )
 	{
+	#ifdef __linux__
+		if ( !this->transfer_type )
+		{
+			return this->put_binary_file( filename );
+		}
+	#endif
+
 		if ( this->is_connected() )
 		{
 			std::ios_base::openmode mode = std::ios_base::in;
@@ -337,24 +976,31 @@ namespace networking
 			{
 				this->set_transfer_type( this->transfer_type );
 
-				if ( this->start_data_connection( "STOR", filename ) )
+				if ( this->start_data_connection( ftp_verb::STOR, filename ) )
 				{
-					while ( !input.eof() )
+					this->transferred_bytes = 0;
+
+					while ( input )
 					{
 						// Reads file content and sends it to the server
-						std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+						input.read( this->message.data(), this->message.size() );
 
-						input >> this->message.data();
+						const auto bytes_read = static_cast< std::size_t >( input.gcount() );
 
-						if ( this->data_socket.send_message( static_cast< void* >( this->message.data() ), strlen( this->message.data() ) ) == 0 )
+						if ( ( bytes_read != 0 ) &&
+							 ( this->send_data( this->message.data(), bytes_read ) <= 0 ) )
 						{
+							this->stop_data_connection( false );
+
 							return false;
 						}
-					}
 
-					this->stop_data_connection( false );
+						this->transferred_bytes += bytes_read;
+					}
 
-					return true;
+					// The server confirms the file was stored once the
+					// connection is closed; a read error truncated it
+					return this->stop_data_connection( false ) && !input.bad();
 				}
 			}
 		}
@@ -362,71 +1008,37 @@ namespace networking
 		return false;
 	}
 
-	// Initialization method
-	void
-	ftp_processor::init()
-	{
-		std::fill( std::begin( this->message ), std::end( this->message ), 0 );
-		this->transfer_type = false;
-		this->host_address.clear();
-		this->data_port = 0;
-	}
-
-	// Sends the PASV request to the server, forcing it to start listening. 
-	// The response should include the host address and the data port;
-	// since we saved the host address at connection time, we only retrieve
-	// the data port.
+	// Retrieves the present working directory without displaying it (PWD command)
 	bool
-	ftp_processor::send_pasv()
+	ftp_processor::get_working_directory( std::string& directory )
 	{
-		if ( this->ftp_command( "PASV", "" ) )
-		{
-			const std::string msg = this->message.data();
+		const auto reply = this->ftp_command( ftp_verb::PWD );
 
-			// Wait for passive mode indicator
-			const std::string passive_mode_flag = "Entering Passive Mode";
+		if ( reply )
+		{
+			// The directory is quoted, with embedded quotes doubled
+			const auto line = *reply.lines().begin();
+			const auto start = line.find( '"' );
 
-			if ( msg.find( passive_mode_flag ) == std::string::npos )
+			if ( start != std::string_view::npos )
 			{
-				if ( !this->receive_reply() )
-				{
-					return false;
-				}
-			}
+				directory.clear();
 
-			// Parse the response to retrieve the data port.
-			// The expected response includes the following sequence of numbers:
-			//		A1, A2, A3, A4, P1, P2 
-			// where A1.A2.A3.A4 is the IP address of the host, while
-			// P1 and P2 should be used to calculate the port number:
-			//		Data port = P1 * 256 + P2
-			std::uint16_t port = 0;
-
-			auto position = 1;
-			for ( std::size_t idx = strlen( this->message.data() ) - 1; idx > 0; --idx )
-			{
-				if ( ::isdigit( static_cast< int >( this->message.data()[idx] ) ) )
+				for ( auto idx = start + 1; idx < line.size(); ++idx )
 				{
-					port += static_cast< std::uint16_t >( position * ( this->message.data()[idx] - '0' ) );
-					position *= 10;
-				} 
-				else if ( position > 1 )
-				{
-					for ( position = 256; idx > 0; --idx )
+					if ( line[idx] == '"' )
 					{
-						if ( ::isdigit( static_cast< int >( this->message.data()[idx] ) ) )
+						if ( ( idx + 1 < line.size() ) && ( line[idx + 1] == '"' ) )
 						{
-							port += static_cast< std::uint16_t >( position * ( this->message.data()[idx] - '0' ) );
-							position *= 10;
+							++idx;
 						}
-						else if ( position > 256 )
+						else
 						{
-							this->data_port = port;
-
 							return true;
 						}
 					}
-					break;
+
+					directory.push_back( line[idx] );
 				}
 			}
 		}
@@ -434,114 +1046,2540 @@ namespace networking
 		return false;
 	}
 
-	// Sets up the socket connection for data transfer. 
-	bool ftp_processor::start_data_connection(
-		std::string const & command,
-		std::string const & parameter )
+	// Retrieves the size of a file on the server (SIZE command).
+	// Returns -1 if the server cannot report it.
+	std::int64_t
+	ftp_processor::get_file_size( std::string const & filename )
 	{
-		if ( this->is_connected() && this->is_data_connected() && this->send_pasv() )
+		if ( this->lacks_capability( ftp_capability::SIZE ) )
 		{
-			this->data_socket.close();
+			return -1;
+		}
+
+		const auto reply = this->ftp_command( ftp_verb::SIZE, filename );
+
+		return parse_file_size( reply.code, reply.text );
+	}
+
+	// Retrieves the time a file on the server was last modified (MDTM
+	// command, RFC 3659), given in UTC as "YYYYMMDDHHMMSS" with optional
+	// fractions of a second
+	bool
+	ftp_processor::get_modification_time(
+		std::string const & filename,
+		std::chrono::system_clock::time_point& time )
+	{
+		// Expected MDTM command reply
+		static constexpr auto FILE_STATUS_OK = 213;
+
+		if ( this->lacks_capability( ftp_capability::MDTM ) )
+		{
+			return false;
+		}
+
+		const auto reply = this->ftp_command( ftp_verb::MDTM, filename );
+
+		if ( ( reply.code != FILE_STATUS_OK ) || ( reply.text.size() <= 4 ) )
+		{
+			return false;
+		}
+
+		const auto line = *reply.lines().begin();
+		auto const * position = line.data() + 4;
+		auto const * const end = line.data() + line.size();
 
-			if ( !this->data_socket.connect_client_socket( this->host_address.c_str(), this->data_port ) )
+		// Parses the next field of the given number of digits
+		const auto parse_field = [&position, end]( std::size_t digits, int& value )
+		{
+			if ( static_cast< std::size_t >( end - position ) < digits )
 			{
 				return false;
 			}
 
-			if ( this->ftp_command( command, parameter ) )
+			const auto result = std::from_chars( position, position + digits, value );
+
+			if ( result.ptr != position + digits )
 			{
-				return true;
+				return false;
 			}
 
-			this->stop_data_connection( true );
-		}
-
-		return false;
-	}
+			position += digits;
 
-	// this->disconnects the socket used for data transfer.
-	// If "abort" flag is not set, the we wait for a server reply. 
-	void
-	ftp_processor::stop_data_connection( bool abort )
-	{
-		if ( this->data_socket.is_connected() )
+			return true;
+		};
+
+		int year = 0;
+		int month = 0;
+		int day = 0;
+		int hours = 0;
+		int minutes = 0;
+		int seconds = 0;
+
+		if ( !parse_field( 4, year ) || !parse_field( 2, month ) || !parse_field( 2, day ) ||
+			 !parse_field( 2, hours ) || !parse_field( 2, minutes ) || !parse_field( 2, seconds ) ||
+			 ( month < 1 ) || ( month > 12 ) || ( day < 1 ) || ( day > 31 ) ||
+			 ( hours > 23 ) || ( minutes > 59 ) || ( seconds > 60 ) )
 		{
-			this->data_socket.close();
+			return false;
 		}
 
-		if ( !abort )
-		{
-			this->receive_reply();
-		}
-	}
+		std::chrono::milliseconds fraction { 0 };
 
-	// Sends a command message to the FTP server and retrieves the reply.
-	// If the reply includes an TCP/IP transfer code < 400, then we consider
-	// that the command transmission was successful.
-	bool
-	ftp_processor::send_command()
-	{
-		if ( this->is_connected() )
+		if ( ( position < end ) && ( *position == '.' ) )
 		{
-			if ( this->command_socket.send_message( static_cast< void* >( this->message.data() ), strlen( this->message.data() ) ) )
+			// Only milliseconds are kept
+			int scale = 100;
+
+			for ( ++position; ( position < end ) && ( *position >= '0' ) && ( *position <= '9' ); ++position )
 			{
-				return this->receive_reply();
+				fraction += std::chrono::milliseconds( ( *position - '0' ) * scale );
+				scale /= 10;
 			}
 		}
 
-		return false;
+		const auto days = days_from_civil( year, static_cast< unsigned >( month ), static_cast< unsigned >( day ) );
+
+		time = std::chrono::system_clock::time_point(
+			std::chrono::duration_cast< std::chrono::system_clock::duration >(
+				std::chrono::hours( days * 24 + hours ) +
+				std::chrono::minutes( minutes ) +
+				std::chrono::seconds( seconds ) +
+				fraction ) );
+
+		return true;
 	}
 
-	// Receives the reply message on a command request sent to the FTP server 
+	// Retrieves the status of the server, or of a file or directory on it,
+	// without displaying it (STAT command). The lines of the reply are
+	// returned without their reply code.
 	bool
-	ftp_processor::receive_reply()
+	ftp_processor::get_status(
+		std::vector< std::string >& lines,
+		std::string const & path )
 	{
-		if ( this->is_connected() )
+		const auto reply = this->ftp_command( ftp_verb::STAT, path );
+
+		if ( !reply )
+		{
+			return false;
+		}
+
+		lines.clear();
+
+		for ( auto line : reply.lines() )
+		{
+			int code = 0;
+
+			if ( ( line.size() >= 4 ) &&
+				 ( std::from_chars( line.data(), line.data() + 3, code ).ptr == line.data() + 3 ) &&
+				 ( code == reply.code ) &&
+				 ( ( line[3] == '-' ) || ( line[3] == ' ' ) ) )
+			{
+				line.remove_prefix( 4 );
+			}
+
+			lines.emplace_back( line );
+		}
+
+		return true;
+	}
+
+	// Starts a binary download at the given offset (REST and RETR commands).
+	// The data is then read with receive_data until it returns 0, and the
+	// transfer closed with close_transfer.
+	bool
+	ftp_processor::open_download(
+		std::string const & filename,
+		std::int64_t offset )
+	{
+		if ( !this->set_transfer_type( false ) )
+		{
+			return false;
+		}
+
+		// Expected REST command reply
+		static constexpr auto PENDING_FURTHER_INFORMATION = 350;
+
+		if ( ( offset > 0 ) &&
+			 ( this->ftp_command( ftp_verb::REST, offset ).code != PENDING_FURTHER_INFORMATION ) )
+		{
+			return false;
+		}
+
+		return this->start_data_connection( ftp_verb::RETR, filename );
+	}
+
+	// Starts a binary upload at the given offset (REST and STOR commands),
+	// or at the end of the remote file (APPE command).
+	// The data is then sent with send_data, and the transfer closed with
+	// close_transfer.
+	bool
+	ftp_processor::open_upload(
+		std::string const & filename,
+		std::int64_t offset,
+		bool append )
+	{
+		if ( !this->set_transfer_type( false ) )
+		{
+			return false;
+		}
+
+		// Expected REST command reply
+		static constexpr auto PENDING_FURTHER_INFORMATION = 350;
+
+		if ( !append && ( offset > 0 ) &&
+			 ( this->ftp_command( ftp_verb::REST, offset ).code != PENDING_FURTHER_INFORMATION ) )
+		{
+			return false;
+		}
+
+		return this->start_data_connection( append ? ftp_verb::APPE : ftp_verb::STOR, filename );
+	}
+
+	// Sends data of an open transfer; returns the number of bytes sent.
+	// In block mode, the data goes out whole, as one or more blocks.
+	// In compressed mode, it is taken whole, and sent as it is compressed.
+	int
+	ftp_processor::send_data(
+		void const * buffer,
+		std::size_t buffer_size )
+	{
+		if ( this->compressed_mode )
+		{
+			this->compressor->set_input( buffer, buffer_size );
+
+			return this->send_compressed_data( false ) ? static_cast< int >( buffer_size ) : -1;
+		}
+
+		if ( !this->block_mode )
+		{
+			return this->data_socket.send_message( const_cast< void* >( buffer ), buffer_size );
+		}
+
+		auto* data = static_cast< char const * >( buffer );
+		std::size_t sent = 0;
+
+		while ( sent < buffer_size )
+		{
+			const auto count = std::min< std::size_t >( buffer_size - sent, BLOCK_MAXIMUM_SIZE );
+
+			const std::array< unsigned char, BLOCK_HEADER_SIZE > header
+			{ {
+				0,
+				static_cast< unsigned char >( count >> 8 ),
+				static_cast< unsigned char >( count & 0xff )
+			} };
+
+			std::array< IOVEC, 2 > buffers
+			{ {
+				make_buffer( header.data(), header.size() ),
+				make_buffer( data + sent, count )
+			} };
+
+			if ( this->data_socket.send_message_all( buffers.data(), buffers.size() ) <= 0 )
+			{
+				return ( sent > 0 ) ? static_cast< int >( sent ) : -1;
+			}
+
+			sent += count;
+		}
+
+		return static_cast< int >( sent );
+	}
+
+	// Receives data of an open transfer; returns 0 once it is complete.
+	// In block mode, the block headers are removed and the end of the file
+	// is the EOF marker rather than the end of the connection.
+	// In compressed mode, the data is decompressed as it arrives, and ends
+	// with the end of the compressed stream.
+	int
+	ftp_processor::receive_data(
+		void* buffer,
+		std::size_t buffer_size )
+	{
+		if ( this->compressed_mode )
+		{
+			return this->receive_compressed_data( buffer, buffer_size );
+		}
+
+		if ( !this->block_mode )
+		{
+			return this->data_socket.receive_message( buffer, buffer_size );
+		}
+
+		while ( this->block_remaining == 0 )
+		{
+			if ( this->block_end_of_file )
+			{
+				return 0;
+			}
+
+			std::array< unsigned char, BLOCK_HEADER_SIZE > header;
+
+			if ( this->data_socket.receive_message_all( header.data(), header.size() ) != static_cast< int >( header.size() ) )
+			{
+				return -1;
+			}
+
+			const auto descriptor = header[0];
+			std::size_t count = ( static_cast< std::size_t >( header[1] ) << 8 ) | header[2];
+
+			// Restart markers carry no file data
+			if ( ( descriptor & BLOCK_RESTART_MARKER ) != 0 )
+			{
+				for ( std::array< char, 64 > skipped; count > 0; )
+				{
+					const auto bytes = this->data_socket.receive_message( skipped.data(), std::min( count, skipped.size() ) );
+
+					if ( bytes <= 0 )
+					{
+						return -1;
+					}
+
+					count -= static_cast< std::size_t >( bytes );
+				}
+
+				continue;
+			}
+
+			this->block_remaining = count;
+			this->block_last = ( descriptor & BLOCK_END_OF_FILE ) != 0;
+			this->block_end_of_file = this->block_last && ( count == 0 );
+		}
+
+		const auto bytes = this->data_socket.receive_message( buffer, std::min( buffer_size, this->block_remaining ) );
+
+		if ( bytes <= 0 )
+		{
+			// The connection may not end a file in block mode
+			return -1;
+		}
+
+		this->block_remaining -= static_cast< std::size_t >( bytes );
+		this->block_end_of_file = this->block_last && ( this->block_remaining == 0 );
+
+		return bytes;
+	}
+
+	// Switches to block mode (MODE B), in which the data connection is kept
+	// open across transfers, or back to stream mode (MODE S)
+	bool
+	ftp_processor::set_block_mode( bool block_mode )
+	{
+		if ( this->ftp_command( ftp_verb::MODE, block_mode ? "B" : "S" ) )
+		{
+			// A connection kept in block mode cannot carry stream transfers
+			if ( !block_mode )
+			{
+				this->data_socket.close();
+				this->data_prefetched = false;
+			}
+
+			this->block_mode = block_mode;
+			this->compressed_mode = false;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool
+	ftp_processor::is_block_mode() const noexcept
+	{
+		return this->block_mode;
+	}
+
+	// Switches to compressed mode (MODE Z), in which the data of transfers
+	// and listings is deflated, if the server lists it among its features,
+	// or back to stream mode (MODE S)
+	bool
+	ftp_processor::set_compressed_mode( bool compressed_mode )
+	{
+		if ( compressed_mode && !this->has_capability( ftp_capability::MODE_Z ) )
+		{
+			return false;
+		}
+
+		if ( this->ftp_command( ftp_verb::MODE, compressed_mode ? "Z" : "S" ) )
+		{
+			// A connection kept in block mode cannot carry compressed transfers
+			if ( this->block_mode )
+			{
+				this->data_socket.close();
+				this->data_prefetched = false;
+			}
+
+			if ( compressed_mode && !this->compressor )
+			{
+				this->compressor.reset( new deflate_stream( true ) );
+				this->decompressor.reset( new deflate_stream( false ) );
+				this->compressed_data.resize( COMPRESSED_BUFFER_SIZE );
+			}
+
+			this->compressed_mode = compressed_mode && this->compressor->is_valid() && this->decompressor->is_valid();
+			this->block_mode = false;
+
+			return this->compressed_mode == compressed_mode;
+		}
+
+		return false;
+	}
+
+	bool
+	ftp_processor::is_compressed_mode() const noexcept
+	{
+		return this->compressed_mode;
+	}
+
+	// Compresses the input set on the compressor, or its end if finishing,
+	// and sends what it produces.
+	// Returns false if the connection fails.
+	bool
+	ftp_processor::send_compressed_data( bool finish )
+	{
+		while ( true )
+		{
+			const auto bytes = this->compressor->compress( this->compressed_data.data(), this->compressed_data.size(), finish );
+
+			if ( bytes < 0 )
+			{
+				return false;
+			}
+
+			auto buffer = make_buffer( this->compressed_data.data(), static_cast< std::size_t >( bytes ) );
+
+			if ( ( bytes > 0 ) && ( this->data_socket.send_message_all( &buffer, 1 ) <= 0 ) )
+			{
+				return false;
+			}
+
+			// A full buffer may leave output pending
+			const bool pending = ( static_cast< std::size_t >( bytes ) == this->compressed_data.size() );
+
+			if ( finish ? this->compressor->is_finished() : ( !this->compressor->has_input() && !pending ) )
+			{
+				return true;
+			}
+		}
+	}
+
+	// Decompresses received data into the buffer, receiving more as needed.
+	// Returns the number of bytes produced, 0 at the end of the stream, or
+	// -1 if the data is corrupt or the connection ends before the stream.
+	int
+	ftp_processor::receive_compressed_data(
+		void* buffer,
+		std::size_t buffer_size )
+	{
+		while ( !this->decompressor->is_finished() )
+		{
+			if ( this->decompressor->has_input() )
+			{
+				const auto bytes = this->decompressor->decompress( buffer, buffer_size );
+
+				if ( bytes != 0 )
+				{
+					return bytes;
+				}
+
+				// Input left without output is past the end of the stream
+				if ( this->decompressor->has_input() )
+				{
+					break;
+				}
+			}
+
+			const auto received = this->data_socket.receive_message( this->compressed_data.data(), this->compressed_data.size() );
+
+			if ( received <= 0 )
+			{
+				return -1;
+			}
+
+			this->decompressor->set_input( this->compressed_data.data(), static_cast< std::size_t >( received ) );
+		}
+
+		return 0;
+	}
+
+	// Sends a whole buffer on the data connection. In stream mode, a large
+	// buffer sent once (zero_copy) is not copied in the kernel; a buffer
+	// refilled between sends is copied, as waiting for the kernel to release
+	// its pages would cost a round trip per send.
+	// Returns the number of bytes sent, or -1 on failure.
+	std::int64_t
+	ftp_processor::send_all_data(
+		void const * data,
+		std::size_t size,
+		bool zero_copy )
+	{
+		if ( zero_copy && !this->block_mode && !this->compressed_mode )
+		{
+			return this->data_socket.send_message_zero_copy( data, size );
+		}
+
+		// Largest count send_data can report
+		static constexpr std::size_t MAXIMUM_SEND_SIZE = 1024 * 1024 * 1024;
+
+		for ( std::size_t sent = 0; sent < size; )
+		{
+			const auto count = this->send_data( static_cast< char const * >( data ) + sent, std::min( size - sent, MAXIMUM_SEND_SIZE ) );
+
+			if ( count <= 0 )
+			{
+				return -1;
+			}
+
+			sent += static_cast< std::size_t >( count );
+		}
+
+		return static_cast< std::int64_t >( size );
+	}
+
+	// Receives a block or compressed mode transfer into a file.
+	// Returns the number of bytes received, or -1 on failure.
+	std::int64_t
+	ftp_processor::receive_data_to_file( int file_handle )
+	{
+	#ifdef __linux__
+		std::int64_t total = 0;
+
+		for ( auto bytes = this->receive_data( this->message.data(), this->message.size() );
+			  bytes != 0;
+			  bytes = this->receive_data( this->message.data(), this->message.size() ) )
+		{
+			if ( ( bytes < 0 ) || ( ::write( file_handle, this->message.data(), static_cast< std::size_t >( bytes ) ) != bytes ) )
+			{
+				return -1;
+			}
+
+			total += bytes;
+		}
+
+		return total;
+	#else
+		static_cast< void >( file_handle );
+
+		return -1;
+	#endif
+	}
+
+	// Sends a file as a block or compressed mode transfer.
+	// Returns the number of bytes sent, or -1 on failure.
+	std::int64_t
+	ftp_processor::send_file_data( int file_handle )
+	{
+	#ifdef __linux__
+		std::int64_t total = 0;
+
+		for ( auto bytes = ::read( file_handle, this->message.data(), this->message.size() );
+			  bytes != 0;
+			  bytes = ::read( file_handle, this->message.data(), this->message.size() ) )
+		{
+			if ( ( bytes < 0 ) || ( this->send_data( this->message.data(), static_cast< std::size_t >( bytes ) ) != bytes ) )
+			{
+				return -1;
+			}
+
+			total += bytes;
+		}
+
+		return total;
+	#else
+		static_cast< void >( file_handle );
+
+		return -1;
+	#endif
+	}
+
+	// Closes an open transfer and waits for its completion reply.
+	// Closing before the end of a download cancels it, and the reply
+	// reporting the cancellation is consumed. When the transfer is cut
+	// short on purpose, with all the data wanted moved, that reply
+	// (426 or 450) completes it as well.
+	bool
+	ftp_processor::close_transfer( bool cut_short )
+	{
+		// Replies reporting a transfer cancelled by the closed connection
+		static constexpr auto CONNECTION_CLOSED = 426;
+		static constexpr auto FILE_UNAVAILABLE = 450;
+
+		const auto completed = this->stop_data_connection( false );
+
+		return completed ||
+			( cut_short && ( ( this->reply_code == CONNECTION_CLOSED ) || ( this->reply_code == FILE_UNAVAILABLE ) ) );
+	}
+
+	// Downloads a file over several sessions, each retrieving a segment of it.
+	// Servers that do not report the file size get a single-stream download.
+	bool
+	ftp_processor::get_file_segmented(
+		std::string const & filename,
+		std::size_t session_count )
+	{
+		const auto file_size = this->get_file_size( filename );
+
+		if ( file_size < 0 )
+		{
+			return this->set_transfer_type( false ) && this->get_binary_file( filename, filename );
+		}
+
+		segmented_transfer transfer( *this, session_count );
+
+		if ( transfer.download( filename, filename, file_size ) )
+		{
+			this->transferred_bytes = transfer.get_transferred_bytes();
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Uploads a file over several sessions, each sending a segment of it.
+	// Servers that cannot restart uploads (no REST STREAM feature) get a
+	// single-stream upload.
+	bool
+	ftp_processor::put_file_segmented(
+		std::string const & filename,
+		std::size_t session_count )
+	{
+	#ifdef __linux__
+		struct stat file_status;
+
+		if ( ::stat( filename.c_str(), &file_status ) != 0 )
+		{
+			return false;
+		}
+
+		if ( !this->has_capability( ftp_capability::REST_STREAM ) )
+		{
+			return this->set_transfer_type( false ) && this->put_binary_file( filename );
+		}
+
+		segmented_transfer transfer( *this, session_count );
+
+		if ( transfer.upload( filename, filename, file_status.st_size ) )
+		{
+			this->transferred_bytes = transfer.get_transferred_bytes();
+
+			return true;
+		}
+	#else
+		static_cast< void >( filename );
+		static_cast< void >( session_count );
+	#endif
+
+		return false;
+	}
+
+	// Checks whether the server lists a feature, such as "REST STREAM" or
+	// "SIZE", in its FEAT reply
+	bool
+	ftp_processor::has_feature( std::string const & feature )
+	{
+		this->query_features();
+
+		// A feature may be followed by its parameters, as in "MLST size*;type*"
+		return std::any_of( this->features.begin(), this->features.end(), [&feature]( std::string const & listed )
+		{
+			return ( listed.compare( 0, feature.size(), feature ) == 0 ) &&
+				( ( listed.size() == feature.size() ) || ( listed[feature.size()] == ' ' ) );
+		} );
+	}
+
+	// Retrieves the features listed by the server (FEAT command), upper cased
+	// and with their parameters, as in "MLST SIZE*;TYPE*"
+	bool
+	ftp_processor::get_features( std::vector< std::string >& features )
+	{
+		this->query_features();
+
+		features = this->features;
+
+		return !this->features.empty();
+	}
+
+	// Queries the features of the server, once per session
+	void
+	ftp_processor::query_features()
+	{
+		if ( !this->features_known && this->is_connected() )
+		{
+			const auto reply = this->ftp_command( ftp_verb::FEAT );
+
+			// Without a reply, the features are still unknown
+			this->features_known = ( reply.code != 0 );
+
+			if ( reply )
+			{
+				// Features are listed one per line, each indented by a space
+				for ( auto const line : reply.lines() )
+				{
+					if ( !line.empty() && ( line[0] == ' ' ) )
+					{
+						std::string feature( line.substr( 1 ) );
+
+						feature.erase( feature.find_last_not_of( ' ' ) + 1 );
+						std::transform( feature.begin(), feature.end(), feature.begin(), ::toupper );
+
+						this->features.push_back( feature );
+					}
+				}
+			}
+		}
+	}
+
+	// Checks whether the server has a capability. Unless known from the
+	// capability cache, the capabilities are discovered (FEAT command) once
+	// per server and added to the cache.
+	bool
+	ftp_processor::has_capability( ftp_capability capability )
+	{
+		if ( !this->capabilities_known && this->is_connected() )
+		{
+			this->query_features();
+
+			if ( this->features_known )
+			{
+				// Features naming the capabilities; MLST comes with MLSD (RFC 3659)
+				static constexpr std::pair< char const *, ftp_capability > CAPABILITY_FEATURES[]
+				{
+					{ "MLST", ftp_capability::MLSD },
+					{ "EPSV", ftp_capability::EPSV },
+					{ "MODE Z", ftp_capability::MODE_Z },
+					{ "MODE B", ftp_capability::MODE_B },
+					{ "REST STREAM", ftp_capability::REST_STREAM },
+					{ "SIZE", ftp_capability::SIZE },
+					{ "MDTM", ftp_capability::MDTM },
+					{ "HASH", ftp_capability::HASH },
+					{ "UTF8", ftp_capability::UTF8 }
+				};
+
+				this->capabilities = capability_set();
+
+				// A server listing no features, or refusing FEAT, leaves
+				// all capabilities unknown
+				if ( !this->features.empty() )
+				{
+					this->capabilities.add( ftp_capability::FEAT );
+				}
+
+				for ( auto const & capability_feature : CAPABILITY_FEATURES )
+				{
+					if ( this->has_feature( capability_feature.first ) )
+					{
+						this->capabilities.add( capability_feature.second );
+					}
+				}
+
+				this->capabilities_known = true;
+
+				capability_cache( this->capability_cache_path ).store(
+					this->host_address, this->server_endpoint.get_port(), this->server_banner, this->capabilities );
+			}
+		}
+
+		return this->capabilities.has( capability );
+	}
+
+	// Checks whether the server is known to lack a capability, without
+	// discovering its capabilities; commands it lacks are not even tried
+	bool
+	ftp_processor::lacks_capability( ftp_capability capability ) const noexcept
+	{
+		return this->capabilities_known && this->capabilities.lacks( capability );
+	}
+
+	// Sets the file keeping the capabilities of servers; an empty path keeps
+	// them for the session only
+	void
+	ftp_processor::set_capability_cache( std::string const & path )
+	{
+		this->capability_cache_path = path;
+	}
+
+	// Lists the files, not the subdirectories, of a directory on the server
+	// (current directory if empty) with their sizes. Servers supporting MLSD
+	// list both at once; others are asked for the size of each name (NLST
+	// and SIZE commands), directories having none.
+	bool
+	ftp_processor::list_files(
+		std::string const & directory,
+		std::vector< remote_file >& files )
+	{
+		files.clear();
+
+		const bool machine_listing = this->has_capability( ftp_capability::MLSD );
+
+		std::string listing;
+
+		if ( !this->receive_listing( machine_listing ? ftp_verb::MLSD : ftp_verb::NLST, directory, listing ) )
+		{
+			return false;
+		}
+
+		for ( std::size_t line_start = 0; line_start < listing.size(); )
+		{
+			auto line_end = listing.find( '\n', line_start );
+
+			if ( line_end == std::string::npos )
+			{
+				line_end = listing.size();
+			}
+
+			auto line = listing.substr( line_start, line_end - line_start );
+			line_start = line_end + 1;
+
+			if ( !line.empty() && ( line.back() == '\r' ) )
+			{
+				line.pop_back();
+			}
+
+			if ( machine_listing )
+			{
+				// Facts, then a space and the name, as in "type=file;size=1234; name"
+				const auto separator = line.find( ' ' );
+
+				if ( separator == std::string::npos )
+				{
+					continue;
+				}
+
+				auto facts = line.substr( 0, separator );
+				std::transform( facts.begin(), facts.end(), facts.begin(), ::tolower );
+
+				if ( ( facts.compare( 0, 10, "type=file;" ) != 0 ) && ( facts.find( ";type=file;" ) == std::string::npos ) )
+				{
+					continue;
+				}
+
+				remote_file file;
+				file.name = line.substr( separator + 1 );
+
+				const auto size_fact = ( facts.compare( 0, 5, "size=" ) == 0 ) ? 0 : facts.find( ";size=" );
+
+				if ( size_fact != std::string::npos )
+				{
+					file.size = std::strtoll( facts.c_str() + facts.find( '=', size_fact ) + 1, nullptr, 10 );
+				}
+
+				files.push_back( file );
+			}
+			else if ( !line.empty() )
+			{
+				// Some servers prefix the names with the directory
+				remote_file file;
+				file.name = line.substr( line.find_last_of( '/' ) + 1 );
+
+				files.push_back( file );
+			}
+		}
+
+		if ( !machine_listing )
+		{
+			const auto prefix = directory.empty() ? std::string() : ( directory + "/" );
+
+			// The sizes are asked for in one pipeline rather than one round
+			// trip per name
+			if ( !this->lacks_capability( ftp_capability::SIZE ) )
+			{
+				std::vector< pipelined_command > size_commands( files.size() );
+
+				for ( std::size_t idx = 0; idx < files.size(); ++idx )
+				{
+					size_commands[idx].command = "SIZE";
+					size_commands[idx].parameter = prefix + files[idx].name;
+				}
+
+				this->pipeline_commands( size_commands );
+
+				for ( std::size_t idx = 0; idx < files.size(); ++idx )
+				{
+					files[idx].size = parse_file_size( size_commands[idx].reply_code, size_commands[idx].reply );
+				}
+			}
+
+			files.erase(
+				std::remove_if( files.begin(), files.end(), []( remote_file const & file ) { return file.size < 0; } ),
+				files.end() );
+		}
+
+		return true;
+	}
+
+	// Retrieves a directory listing without displaying it
+	bool
+	ftp_processor::receive_listing(
+		ftp_verb command,
+		std::string const & directory,
+		std::string& listing )
+	{
+		listing.clear();
+
+		if ( this->start_data_connection( command, directory ) )
+		{
+			auto bytes = 0;
+
+			while ( ( bytes = this->receive_data( this->message.data(), this->message.size() ) ) > 0 )
+			{
+				listing.append( this->message.data(), static_cast< std::size_t >( bytes ) );
+			}
+
+			return this->stop_data_connection( false ) && ( bytes == 0 );
+		}
+
+		return false;
+	}
+
+	// Uploads an in-memory buffer, such as a mapped file, to the FTP server
+	// (STOR command). Large buffers are sent with MSG_ZEROCOPY, so the kernel
+	// transmits straight from the caller's pages.
+	bool
+	ftp_processor::put_data(
+		std::string const & filename,
+		void const * data,
+		std::size_t size )
+	{
+		if ( this->is_connected() && ( data != nullptr ) )
+		{
+			if ( this->set_transfer_type( false ) &&
+				 this->start_data_connection( ftp_verb::STOR, filename ) )
+			{
+				const auto bytes = this->send_all_data( data, size, true );
+
+				if ( this->stop_data_connection( false ) && ( bytes >= 0 ) && this->is_transfer_complete( bytes, -1 ) )
+				{
+					this->transferred_bytes = bytes;
+
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Makes binary transfers keep a checkpoint next to the local file, from
+	// which they resume after an interruption. Checkpointed transfers read
+	// the data to checksum it, bypassing the transfer engine.
+	void
+	ftp_processor::set_resumable( bool resumable ) noexcept
+	{
+		this->resumable = resumable;
+	}
+
+	bool
+	ftp_processor::is_resumable() const noexcept
+	{
+		return this->resumable;
+	}
+
+	// Selects the engine used for binary transfers.
+	// Returns false if the requested engine is unavailable, in which
+	// case the standard engine is used instead.
+	bool
+	ftp_processor::set_transfer_engine( transfer_engine_kind kind )
+	{
+		if ( this->engine->get_kind() != kind )
+		{
+			this->engine = transfer_engine::create( kind );
+		}
+
+		return this->engine->get_kind() == kind;
+	}
+
+	transfer_engine_kind
+	ftp_processor::get_transfer_engine() const noexcept
+	{
+		return this->engine->get_kind();
+	}
+
+	// Checks that the completion reply, the last one received, confirms
+	// the transfer (226 or 250) and that the bytes moved match the size
+	// announced by the server, either in the preliminary or in the completion
+	// reply, when there was one.
+	bool
+	ftp_processor::is_transfer_complete(
+		std::int64_t bytes,
+		std::int64_t announced_bytes ) const
+	{
+		// Expected transfer completion replies
+		static constexpr auto TRANSFER_OK = 226;
+		static constexpr auto FILE_ACTION_OK = 250;
+
+		if ( ( this->reply_code != TRANSFER_OK ) && ( this->reply_code != FILE_ACTION_OK ) )
+		{
+			return false;
+		}
+
+		const auto completed_bytes = parse_transfer_size( this->reply_text.data() );
+
+		for ( const auto expected_bytes : { announced_bytes, completed_bytes } )
+		{
+			if ( ( expected_bytes >= 0 ) && ( expected_bytes != bytes ) )
+			{
+				std::cerr << "Transfer incomplete: " << bytes << " of " << expected_bytes << " bytes." << std::endl;
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Sets the TCP options of subsequent data connections
+	void
+	ftp_processor::set_data_profile( socket_profile const & profile )
+	{
+		this->data_socket.set_profile( profile );
+		this->data_socket_pool.set_profile( profile );
+	}
+
+	// Sets the timeouts and retries of the command and data connections
+	void
+	ftp_processor::set_connect_policy( connect_policy const & policy ) noexcept
+	{
+		this->command_socket.set_connect_policy( policy );
+		this->data_socket.set_connect_policy( policy );
+		this->data_socket_pool.set_connect_policy( policy );
+	}
+
+	// Returns the outcome of the last command connection
+	connect_metrics
+	ftp_processor::get_connect_metrics() const noexcept
+	{
+		return this->command_socket.get_connect_metrics();
+	}
+
+	// Returns the outcome of the last data connection
+	connect_metrics
+	ftp_processor::get_data_connect_metrics() const noexcept
+	{
+		return this->data_socket.get_connect_metrics();
+	}
+
+	// Returns the number of bytes moved by the last file transfer
+	std::int64_t
+	ftp_processor::get_transferred_bytes() const noexcept
+	{
+		return this->transferred_bytes;
+	}
+
+	// Initialization method
+	void
+	ftp_processor::init()
+	{
+		std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+		this->clear_reply();
+		this->transfer_type = false;
+		this->host_address.clear();
+		this->user_name.clear();
+		this->user_password.clear();
+		this->features.clear();
+		this->features_known = false;
+		this->capabilities = capability_set();
+		this->capabilities_known = false;
+		this->server_banner.clear();
+		this->block_mode = false;
+		this->compressed_mode = false;
+		this->data_prefetched = false;
+		this->server_endpoint = endpoint {};
+		this->data_socket_pool.clear();
+		this->data_port = 0;
+		this->replies.clear();
+	}
+
+	// Requests a passive data port from the server, with the command that
+	// worked last with it, EPSV (RFC 2428) by default, and then with the
+	// other one if the server refuses it.
+	// The data connection goes to the address of the command connection:
+	// EPSV only carries a port, and the address in a PASV reply is ignored,
+	// as it is often private behind NAT and could point to another host.
+	bool
+	ftp_processor::send_pasv()
+	{
+		const auto command = this->get_passive_command();
+
+		if ( this->ftp_command( command ) && this->parse_pasv_reply() )
+		{
+			return true;
+		}
+
+		// Only a refusal gets the other command; PASV cannot reach IPv6 servers
+		const auto extended = ( command == ftp_verb::EPSV );
+
+		if ( !this->is_connected() ||
+			 ( this->reply_code < 500 ) ||
+			 ( extended && ( this->server_endpoint.get_family() == AF_INET6 ) ) )
+		{
+			return false;
+		}
+
+		if ( this->ftp_command( extended ? ftp_verb::PASV : ftp_verb::EPSV ) && this->parse_pasv_reply() )
+		{
+			set_extended_passive_refused( this->host_address, this->server_endpoint.get_port(), extended );
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Returns the command requesting a passive port that works with the server
+	ftp_verb
+	ftp_processor::get_passive_command() const
+	{
+		// Servers not listing EPSV go straight to PASV, which cannot reach
+		// IPv6 servers
+		const bool extended = !is_extended_passive_refused( this->host_address, this->server_endpoint.get_port() ) &&
+			!( this->lacks_capability( ftp_capability::EPSV ) && ( this->server_endpoint.get_family() == AF_INET ) );
+
+		return extended ? ftp_verb::EPSV : ftp_verb::PASV;
+	}
+
+	// Retrieves the data port from the PASV (227) or EPSV (229) reply, the
+	// last one received
+	bool
+	ftp_processor::parse_pasv_reply()
+	{
+		// Expected PASV and EPSV replies
+		static constexpr auto ENTERING_PASSIVE_MODE = 227;
+		static constexpr auto ENTERING_EXTENDED_PASSIVE_MODE = 229;
+
+		std::uint16_t port = 0;
+
+		switch ( this->reply_code )
+		{
+		case ENTERING_PASSIVE_MODE:
+			if ( !parse_passive_port( this->reply_text.data(), port ) )
+			{
+				return false;
+			}
+			break;
+
+		case ENTERING_EXTENDED_PASSIVE_MODE:
+			if ( !parse_extended_passive_port( this->reply_text.data(), port ) )
+			{
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		this->data_port = port;
+
+		return true;
+	}
+
+	// Sets up the socket connection for data transfer. 
+	// In block mode, the connection of the previous transfer is reused.
+	bool ftp_processor::start_data_connection(
+		ftp_verb command,
+		std::string_view parameter )
+	{
+		if ( !this->is_connected() )
+		{
+			return false;
+		}
+
+		if ( !this->is_data_connected() )
+		{
+			if ( !this->send_pasv() )
+			{
+				return false;
+			}
+
+			this->data_socket = this->data_socket_pool.acquire( this->server_endpoint.get_family() );
+
+			auto data_endpoint = this->server_endpoint;
+			data_endpoint.set_port( this->data_port );
+
+			if ( !this->data_socket.connect_client_socket( data_endpoint ) )
+			{
+				return false;
+			}
+		}
+		else if ( !this->block_mode && !this->data_prefetched )
+		{
+			return false;
+		}
+
+		// Block mode reads headers of a few bytes on a connection that stays
+		// open; the kernel would not wake a receive for less than the low
+		// water mark of bulk sockets
+		if ( this->block_mode )
+		{
+			this->data_socket.set_receive_low_water_mark( 1 );
+		}
+
+		this->data_prefetched = false;
+		this->block_remaining = 0;
+		this->block_last = false;
+		this->block_end_of_file = false;
+		this->sending_data = ( command == ftp_verb::STOR ) || ( command == ftp_verb::APPE ) || ( command == ftp_verb::STOU );
+
+		// Each transfer is a stream of its own
+		if ( this->compressed_mode && !( this->sending_data ? this->compressor : this->decompressor )->reset() )
+		{
+			return false;
+		}
+
+		// Open ahead of the reply, so that a cancellation while waiting
+		// for it aborts the transfer once it starts
+		this->cancel_requested = 0;
+		this->transfer_open = 1;
+
+		if ( this->ftp_command( command, parameter ) )
+		{
+			return true;
+		}
+
+		this->transfer_open = 0;
+
+		// A refused command leaves a block mode connection usable
+		if ( !this->block_mode )
+		{
+			this->stop_data_connection( true );
+		}
+
+		return false;
+	}
+
+	// this->disconnects the socket used for data transfer.
+	// If "abort" flag is not set, the we wait for a server reply.
+	// Returns false if the completion reply reports a failure.
+	// In block mode, a complete transfer ends with an EOF marker instead,
+	// and the connection is kept for the next transfer.
+	bool
+	ftp_processor::stop_data_connection( bool abort )
+	{
+		// A transfer cancelled meanwhile is aborted as well, and fails
+		const bool cancelled = ( this->cancel_requested != 0 );
+		const bool transferring = ( this->transfer_open != 0 );
+
+		this->transfer_open = 0;
+		this->cancel_requested = 0;
+
+		if ( ( abort || cancelled ) && transferring )
+		{
+			const auto aborted = this->abort_transfer();
+
+			return aborted && !cancelled;
+		}
+
+		bool prefetching = false;
+		bool flushed = true;
+
+		if ( this->data_socket.is_connected() )
+		{
+			static constexpr std::array< unsigned char, BLOCK_HEADER_SIZE > end_of_file { { BLOCK_END_OF_FILE, 0, 0 } };
+
+			const bool keep = this->block_mode && !abort &&
+				( this->sending_data ?
+					( this->data_socket.send_message( const_cast< unsigned char* >( end_of_file.data() ), end_of_file.size() ) == static_cast< int >( end_of_file.size() ) ) :
+					this->block_end_of_file );
+
+			if ( !keep )
+			{
+				// The end of the compressed stream completes an upload
+				if ( this->compressed_mode && this->sending_data && !abort )
+				{
+					flushed = this->send_compressed_data( true );
+				}
+
+				this->data_socket.close();
+
+				// Ask for the next passive port ahead of the completion reply,
+				// so that both arrive together
+				prefetching = this->pasv_prefetch && !abort && !this->block_mode && this->send_command_line( this->get_passive_command() );
+
+				// Prepare the next data socket while the server completes this transfer
+				this->data_socket_pool.fill( this->server_endpoint.get_family() );
+			}
+		}
+
+		this->data_prefetched = false;
+
+		if ( !abort )
+		{
+			const auto completed = this->receive_reply();
+
+			if ( prefetching )
+			{
+				this->prefetch_data_connection();
+			}
+
+			return completed && flushed;
+		}
+
+		return true;
+	}
+
+	// Aborts a transfer as set out by RFC 959, section 4.1.3: the Telnet
+	// Interrupt Process and Synch signals go out as urgent data, so that a
+	// server busy with the data connection looks at the command connection,
+	// followed by ABOR. The data connection is closed and the replies to the
+	// transfer and to ABOR are consumed, leaving the command connection
+	// ready for the next command.
+	bool
+	ftp_processor::abort_transfer()
+	{
+		this->transfer_open = 0;
+		this->cancel_requested = 0;
+
+		const bool sent = this->send_abort();
+
+		// Closing the data connection unblocks a server writing to it
+		if ( this->data_socket.is_connected() )
+		{
+			this->data_socket.close();
+			this->data_socket_pool.fill( this->server_endpoint.get_family() );
+		}
+
+		this->data_prefetched = false;
+		this->block_remaining = 0;
+		this->block_end_of_file = false;
+
+		return sent && this->drain_abort_replies();
+	}
+
+	// Sends the Telnet Interrupt Process and Synch signals, then ABOR.
+	// The Data Mark closing the Synch starts the command line, which is
+	// followed by NOOP: whether the transfer completed before ABOR arrived
+	// or not, its reply marks the end of the replies to drain.
+	bool
+	ftp_processor::send_abort()
+	{
+		// Telnet IAC IP, then the IAC opening the Synch, sent urgent
+		static constexpr unsigned char interrupt[] = { 0xff, 0xf4, 0xff };
+		static constexpr char commands[] = "\xf2" "ABOR\r\n" "NOOP\r\n";
+
+		auto buffer = make_buffer( commands, sizeof( commands ) - 1 );
+
+		return this->is_connected() &&
+			( this->command_socket.send_urgent_message( interrupt, sizeof( interrupt ) ) == static_cast< int >( sizeof( interrupt ) ) ) &&
+			this->send_command_buffers( &buffer, 1 );
+	}
+
+	// Consumes the replies to an aborted transfer: 426 for the interrupted
+	// transfer, then 226 or 225 for ABOR, up to the reply to NOOP
+	bool
+	ftp_processor::drain_abort_replies()
+	{
+		// Expected NOOP reply
+		static constexpr auto NOOP_OK = 200;
+
+		while ( this->is_connected() )
+		{
+			const auto reply = this->receive_reply();
+
+			if ( reply.code == 0 )
+			{
+				break;
+			}
+
+			if ( reply.code == NOOP_OK )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Requests the cancellation of the open transfer, and returns false if
+	// there is none. The data connection is shut down, which stops the
+	// transfer at once; the transfer then fails, and is aborted with ABOR.
+	// Only makes system calls, so it may be called from a signal handler.
+	bool
+	ftp_processor::cancel_transfer() noexcept
+	{
+		if ( this->transfer_open == 0 )
+		{
+			return false;
+		}
+
+		this->cancel_requested = 1;
+		this->data_socket.shutdown();
+
+		return true;
+	}
+
+	// Connects the data socket of the next transfer to the port of the
+	// prefetched PASV reply. The completion reply of the previous transfer
+	// is left as the last reply.
+	void
+	ftp_processor::prefetch_data_connection()
+	{
+		const auto completion_code = this->reply_code;
+		const auto completion_length = this->reply_length;
+		const std::string completion_reply( this->reply_text.data(), this->reply_length );
+
+		if ( this->receive_reply() && this->parse_pasv_reply() )
+		{
+			this->data_socket = this->data_socket_pool.acquire( this->server_endpoint.get_family() );
+
+			auto data_endpoint = this->server_endpoint;
+			data_endpoint.set_port( this->data_port );
+
+			this->data_prefetched = this->data_socket.connect_client_socket( data_endpoint );
+		}
+
+		std::copy( std::begin( completion_reply ), std::end( completion_reply ), std::begin( this->reply_text ) );
+		this->reply_text[completion_length] = 0;
+		this->reply_code = completion_code;
+		this->reply_length = completion_length;
+	}
+
+	// Sends a command line without waiting for its reply
+	bool
+	ftp_processor::send_command_line( ftp_verb command )
+	{
+		this->encoder.clear();
+
+		if ( !this->is_connected() || !this->encoder.append( command ) )
+		{
+			return false;
+		}
+
+		auto buffer = make_buffer( this->encoder.data(), this->encoder.size() );
+
+		return this->send_command_buffers( &buffer, 1 );
+	}
+
+	// Makes each stream mode transfer request the passive port of the next
+	// one, and connect to it, as it completes. Meant for batches of
+	// transfers; the last one leaves an unused data connection.
+	void
+	ftp_processor::set_pasv_prefetch( bool prefetch ) noexcept
+	{
+		this->pasv_prefetch = prefetch;
+
+		// No transfer would take a data connection prefetched already
+		if ( !prefetch && this->data_prefetched )
+		{
+			this->data_socket.close();
+			this->data_prefetched = false;
+		}
+	}
+
+	bool
+	ftp_processor::is_pasv_prefetch() const noexcept
+	{
+		return this->pasv_prefetch;
+	}
+
+	// Downloads a file in binary mode through the transfer engine
+	bool
+	ftp_processor::get_binary_file(
+		std::string const & filename,
+		std::string const & local_filename )
+	{
+	#ifdef __linux__
+		if ( this->resumable )
+		{
+			return this->get_resumable_file( filename, local_filename );
+		}
+
+		if ( this->is_connected() )
+		{
+			const auto file_handle = ::open( local_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+			if ( file_handle != -1 )
+			{
+				bool success = false;
+
+				if ( this->set_transfer_type( this->transfer_type ) &&
+					 this->start_data_connection( ftp_verb::RETR, filename ) )
+				{
+					// Size announced by the preliminary reply, if any
+					const auto announced_bytes = parse_transfer_size( this->reply_text.data() );
+
+					// Block and compressed modes transform the data, which the
+					// engines do not decode
+					const auto bytes = ( this->block_mode || this->compressed_mode ) ?
+						this->receive_data_to_file( file_handle ) :
+						this->engine->receive_to_file( this->data_socket, file_handle );
+
+					success = this->stop_data_connection( false ) && ( bytes >= 0 ) && this->is_transfer_complete( bytes, announced_bytes );
+
+					if ( success )
+					{
+						this->transferred_bytes = bytes;
+					}
+				}
+
+				::close( file_handle );
+
+				return success;
+			}
+		}
+	#else
+		static_cast< void >( filename );
+		static_cast< void >( local_filename );
+	#endif
+
+		return false;
+	}
+
+	// Uploads a file in binary mode through the transfer engine
+	bool
+	ftp_processor::put_binary_file( std::string const & filename )
+	{
+	#ifdef __linux__
+		if ( this->resumable )
+		{
+			return this->put_resumable_file( filename );
+		}
+
+		if ( this->is_connected() )
+		{
+			const auto file_handle = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+
+			if ( file_handle != -1 )
+			{
+				bool success = false;
+
+				if ( this->set_transfer_type( this->transfer_type ) &&
+					 this->start_data_connection( ftp_verb::STOR, filename ) )
+				{
+					const auto bytes = ( this->block_mode || this->compressed_mode ) ?
+						this->send_file_data( file_handle ) :
+						this->engine->send_from_file( file_handle, this->data_socket );
+
+					if ( this->stop_data_connection( false ) && ( bytes >= 0 ) && this->is_transfer_complete( bytes, -1 ) )
+					{
+						this->transferred_bytes = bytes;
+
+						success = true;
+					}
+				}
+
+				::close( file_handle );
+
+				return success;
+			}
+		}
+	#else
+		static_cast< void >( filename );
+	#endif
+
+		return false;
+	}
+
+	// Downloads a file in binary mode, resuming from its checkpoint if the
+	// local file still matches it and the remote file kept its size.
+	// The bytes go through a buffer to extend the checksum, and the
+	// checkpoint is saved periodically, once they are on disk.
+	bool
+	ftp_processor::get_resumable_file(
+		std::string const & filename,
+		std::string const & local_filename )
+	{
+	#ifdef __linux__
+		if ( this->is_connected() )
+		{
+			const auto file_size = this->get_file_size( filename );
+
+			const auto file_handle = ::open( local_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+
+			if ( file_handle != -1 )
+			{
+				transfer_checkpoint checkpoint( local_filename );
+
+				if ( !checkpoint.load() ||
+					 ( file_size < 0 ) ||
+					 ( checkpoint.get_file_size() != file_size ) ||
+					 !checkpoint.verify( file_handle ) )
+				{
+					checkpoint.reset( file_size );
+				}
+
+				// Servers without REST get the whole file again
+				bool opened = ( ::ftruncate( file_handle, checkpoint.get_offset() ) == 0 ) &&
+					this->open_download( filename, checkpoint.get_offset() );
+
+				if ( !opened && ( checkpoint.get_offset() > 0 ) )
+				{
+					checkpoint.reset( file_size );
+
+					opened = ( ::ftruncate( file_handle, 0 ) == 0 ) && this->open_download( filename, 0 );
+				}
+
+				bool success = false;
+
+				if ( opened )
+				{
+					static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+					static constexpr std::int64_t CHECKPOINT_INTERVAL = 8 * 1024 * 1024;
+
+					std::vector< char > buffer( BUFFER_SIZE );
+					std::int64_t bytes = 0;
+					std::int64_t unsaved_bytes = 0;
+
+					for ( auto received = this->receive_data( buffer.data(), buffer.size() );
+						  received != 0;
+						  received = this->receive_data( buffer.data(), buffer.size() ) )
+					{
+						if ( ( received < 0 ) || ( ::pwrite( file_handle, buffer.data(), static_cast< std::size_t >( received ), checkpoint.get_offset() ) != received ) )
+						{
+							bytes = -1;
+
+							break;
+						}
+
+						checkpoint.update( buffer.data(), static_cast< std::size_t >( received ) );
+
+						bytes += received;
+						unsaved_bytes += received;
+
+						if ( ( unsaved_bytes >= CHECKPOINT_INTERVAL ) && ( ::fdatasync( file_handle ) == 0 ) )
+						{
+							checkpoint.save();
+
+							unsaved_bytes = 0;
+						}
+					}
+
+					success = this->stop_data_connection( false ) &&
+						( bytes >= 0 ) &&
+						this->is_transfer_complete( bytes, -1 ) &&
+						( ( file_size < 0 ) || ( checkpoint.get_offset() == file_size ) );
+
+					if ( success )
+					{
+						this->transferred_bytes = bytes;
+					}
+				}
+
+				if ( success )
+				{
+					checkpoint.remove();
+				}
+				else if ( ::fdatasync( file_handle ) == 0 )
+				{
+					checkpoint.save();
+				}
+
+				::close( file_handle );
+
+				return success;
+			}
+		}
+	#else
+		static_cast< void >( filename );
+		static_cast< void >( local_filename );
+	#endif
+
+		return false;
+	}
+
+	// Uploads a file in binary mode, resuming from its checkpoint if the
+	// local file still matches it. The upload restarts at the checkpoint
+	// or at the size the server stored, whichever is smaller.
+	bool
+	ftp_processor::put_resumable_file( std::string const & filename )
+	{
+	#ifdef __linux__
+		if ( this->is_connected() )
+		{
+			const auto file_handle = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+
+			if ( file_handle != -1 )
+			{
+				struct stat file_status;
+
+				if ( ::fstat( file_handle, &file_status ) != 0 )
+				{
+					::close( file_handle );
+
+					return false;
+				}
+
+				const std::int64_t file_size = file_status.st_size;
+
+				transfer_checkpoint checkpoint( filename );
+
+				if ( checkpoint.load() &&
+					 ( checkpoint.get_file_size() == file_size ) &&
+					 checkpoint.verify( file_handle ) )
+				{
+					const auto stored_size = this->get_file_size( filename );
+
+					if ( ( stored_size < 0 ) || !checkpoint.rewind( file_handle, std::min( stored_size, checkpoint.get_offset() ) ) )
+					{
+						checkpoint.reset( file_size );
+					}
+				}
+				else
+				{
+					checkpoint.reset( file_size );
+				}
+
+				// Servers without REST get the whole file again
+				bool opened = this->open_upload( filename, checkpoint.get_offset(), false );
+
+				if ( !opened && ( checkpoint.get_offset() > 0 ) )
+				{
+					checkpoint.reset( file_size );
+
+					opened = this->open_upload( filename, 0, false );
+				}
+
+				bool success = false;
+
+				if ( opened )
+				{
+					static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+					static constexpr std::int64_t CHECKPOINT_INTERVAL = 8 * 1024 * 1024;
+
+					std::vector< char > buffer( BUFFER_SIZE );
+					std::int64_t bytes = 0;
+					std::int64_t unsaved_bytes = 0;
+
+					while ( checkpoint.get_offset() < file_size )
+					{
+						const auto read = ::pread( file_handle, buffer.data(), buffer.size(), checkpoint.get_offset() );
+
+						if ( ( read <= 0 ) ||
+							 ( this->send_all_data( buffer.data(), static_cast< std::size_t >( read ), false ) != read ) )
+						{
+							bytes = -1;
+
+							break;
+						}
+
+						checkpoint.update( buffer.data(), static_cast< std::size_t >( read ) );
+
+						bytes += read;
+						unsaved_bytes += read;
+
+						if ( unsaved_bytes >= CHECKPOINT_INTERVAL )
+						{
+							checkpoint.save();
+
+							unsaved_bytes = 0;
+						}
+					}
+
+					success = this->stop_data_connection( false ) && ( bytes >= 0 ) && this->is_transfer_complete( bytes, -1 );
+
+					if ( success )
+					{
+						this->transferred_bytes = bytes;
+					}
+				}
+
+				if ( success )
+				{
+					checkpoint.remove();
+				}
+				else
+				{
+					checkpoint.save();
+				}
+
+				::close( file_handle );
+
+				return success;
+			}
+		}
+	#else
+		static_cast< void >( filename );
+	#endif
+
+		return false;
+	}
+
+	// Sends a command message to the FTP server and retrieves the reply.
+	// If the reply includes an TCP/IP transfer code < 400, then we consider
+	// that the command transmission was successful.
+	reply_view
+	ftp_processor::send_command(
+		IOVEC* buffers,
+		std::size_t buffer_count )
+	{
+		if ( this->send_command_buffers( buffers, buffer_count ) )
+		{
+			return this->receive_reply();
+		}
+
+		return {};
+	}
+
+	// Receives the reply message on a command request sent to the FTP server.
+	// A reply may span several segments and a segment may hold more than one
+	// reply; received bytes past the current reply are kept for the next call.
+	// The reply is kept until the next one, and passed to the reply handler.
+	reply_view
+	ftp_processor::receive_reply()
+	{
+		reply_view reply;
+
+		this->clear_reply();
+
+		while ( this->is_connected() )
+		{
+			if ( this->replies.next( reply ) )
+			{
+				this->keep_reply( reply );
+
+				return this->get_reply();
+			}
+
+			// Replies of an attached session are read as the reactor finds
+			// them, while it serves the other sockets registered with it
+			if ( this->is_attached() )
+			{
+				if ( this->events->poll( -1 ) == -1 )
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			std::size_t size = 0;
+			auto* buffer = this->replies.prepare( size );
+
+			const auto bytes = this->command_socket.receive_message( buffer, size );
+
+			if ( bytes <= 0 )
+			{
+				break;
+			}
+
+			this->replies.commit( static_cast< std::size_t >( bytes ) );
+		}
+
+		return {};
+	}
+
+	// Keeps the reply as the last one received, and passes it to the
+	// reply handler
+	void
+	ftp_processor::keep_reply( reply_view const & reply )
+	{
+		this->reply_length = std::min( reply.text.size(), this->reply_text.size() - 1 );
+		this->reply_code = reply.code;
+
+		std::copy( reply.text.begin(), reply.text.begin() + this->reply_length, std::begin( this->reply_text ) );
+		this->reply_text[this->reply_length] = 0;
+
+		if ( this->reply_listener )
+		{
+			this->reply_listener( this->get_reply() );
+		}
+	}
+
+	// Returns the last reply received, or a reply without code if the last
+	// command had none. Its text is valid until the next command.
+	reply_view
+	ftp_processor::get_reply() const noexcept
+	{
+		reply_view reply;
+
+		reply.code = this->reply_code;
+		reply.text = std::string_view( this->reply_text.data(), this->reply_length );
+
+		return reply;
+	}
+
+	// Sets the function called with each reply received, as when displaying
+	// them; sessions opened from this one do not call it
+	void
+	ftp_processor::set_reply_handler( reply_handler handler )
+	{
+		this->reply_listener = std::move( handler );
+	}
+
+	// Sets the function called with the data of directory listings (ls,
+	// ldname), as it is received
+	void
+	ftp_processor::set_listing_handler( listing_handler handler )
+	{
+		this->listing_listener = std::move( handler );
+	}
+
+	void
+	ftp_processor::clear_reply() noexcept
+	{
+		this->reply_code = 0;
+		this->reply_length = 0;
+		this->reply_text[0] = 0;
+	}
+
+	// Attaches the session to a reactor. Its command socket turns
+	// non-blocking and its replies are parsed as they arrive. Commands
+	// still wait for their reply, running the reactor meanwhile, so that
+	// the other sessions attached to it make progress; transfers started
+	// with start_get_file and start_put_file do not wait at all.
+	// An attached session must not be moved.
+	bool
+	ftp_processor::attach( reactor& events )
+	{
+		if ( this->is_attached() || !this->is_connected() )
+		{
+			return false;
+		}
+
+		if ( !events.add( this->command_socket, reactor::readable, [this]( std::uint32_t ready )
+		{
+			this->receive_command_events( ready );
+		} ) )
+		{
+			return false;
+		}
+
+		this->events = &events;
+
+		return true;
+	}
+
+	// Detaches the session from its reactor, and makes its sockets block
+	// again. A started transfer is aborted, and its handler is not called.
+	void
+	ftp_processor::detach()
+	{
+		if ( !this->is_attached() )
+		{
+			return;
+		}
+
+		const bool abandoned = this->is_transfer_started();
+		const bool aborting = abandoned && ( this->started->step == transfer_step::aborting );
+
+		if ( abandoned )
+		{
+			this->end_started_data();
+
+			::close( this->started->file_handle );
+			this->started.reset();
+		}
+
+		this->events->remove( this->command_socket );
+		this->events = nullptr;
+		this->command_socket.set_blocking( true );
+
+		// ABOR was sent already by a transfer that failed
+		if ( aborting )
+		{
+			this->drain_abort_replies();
+		}
+		else if ( abandoned )
+		{
+			this->abort_transfer();
+		}
+
+		this->transfer_open = 0;
+		this->cancel_requested = 0;
+	}
+
+	bool
+	ftp_processor::is_attached() const noexcept
+	{
+		return ( this->events != nullptr );
+	}
+
+	// Starts downloading a file into the local file, on an attached session
+	// in stream mode; the handler is called from the reactor once it ended.
+	// Until then, the session takes no other command.
+	bool
+	ftp_processor::start_get_file(
+		std::string const & filename,
+		std::string const & local_filename,
+		completion_handler handler )
+	{
+	#ifdef __linux__
+		if ( this->is_attached() && !this->is_transfer_started() )
+		{
+			const auto file_handle = ::open( local_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+			if ( file_handle != -1 )
+			{
+				return this->start_transfer( ftp_verb::RETR, filename, file_handle, std::move( handler ) );
+			}
+		}
+	#else
+		static_cast< void >( filename );
+		static_cast< void >( local_filename );
+		static_cast< void >( handler );
+	#endif
+
+		return false;
+	}
+
+	// Starts uploading a file, on an attached session in stream mode; the
+	// handler is called from the reactor once it ended. Until then, the
+	// session takes no other command.
+	bool
+	ftp_processor::start_put_file(
+		std::string const & filename,
+		completion_handler handler )
+	{
+	#ifdef __linux__
+		if ( this->is_attached() && !this->is_transfer_started() )
+		{
+			const auto file_handle = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+
+			if ( file_handle != -1 )
+			{
+				return this->start_transfer( ftp_verb::STOR, filename, file_handle, std::move( handler ) );
+			}
+		}
+	#else
+		static_cast< void >( filename );
+		static_cast< void >( handler );
+	#endif
+
+		return false;
+	}
+
+	// Checks whether a transfer started on the reactor has not ended yet
+	bool
+	ftp_processor::is_transfer_started() const noexcept
+	{
+		return ( this->started != nullptr );
+	}
+
+	// Starts a transfer of the file by asking for a passive port; the
+	// reactor takes it from there. The file is closed if it cannot start.
+	bool
+	ftp_processor::start_transfer(
+		ftp_verb command,
+		std::string const & filename,
+		int file_handle,
+		completion_handler handler )
+	{
+	#ifdef __linux__
+		// Data read or written per system call
+		static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+
+		// Block and compressed modes frame the data, and a prefetched data
+		// connection belongs to a transfer that waits for it
+		if ( !this->is_connected() || this->is_data_connected() || this->block_mode || this->compressed_mode )
+		{
+			::close( file_handle );
+
+			return false;
+		}
+
+		this->started = std::make_unique< started_transfer >();
+		this->started->command = command;
+		this->started->filename = filename;
+		this->started->file_handle = file_handle;
+		this->started->passive_command = this->get_passive_command();
+		this->started->buffer.resize( BUFFER_SIZE );
+		this->started->handler = std::move( handler );
+
+		this->sending_data = ( command == ftp_verb::STOR );
+		this->transferred_bytes = 0;
+		this->cancel_requested = 0;
+		this->transfer_open = 1;
+
+		if ( this->send_command_line( this->started->passive_command ) )
+		{
+			return true;
+		}
+
+		::close( file_handle );
+
+		this->started.reset();
+		this->transfer_open = 0;
+	#else
+		static_cast< void >( command );
+		static_cast< void >( filename );
+		static_cast< void >( file_handle );
+		static_cast< void >( handler );
+	#endif
+
+		return false;
+	}
+
+	// Reads what the command socket has ready into the reply parser, then
+	// moves the started transfer on with the replies now complete
+	void
+	ftp_processor::receive_command_events( std::uint32_t ready )
+	{
+		if ( ready & reactor::writable )
+		{
+			this->command_writable = true;
+		}
+
+		if ( ready & ( reactor::readable | reactor::error | reactor::hangup ) )
+		{
+			while ( true )
+			{
+				std::size_t size = 0;
+				auto* buffer = this->replies.prepare( size );
+
+				const auto bytes = this->command_socket.receive_message( buffer, size );
+
+				if ( bytes == socket::WOULD_BLOCK )
+				{
+					break;
+				}
+
+				if ( bytes <= 0 )
+				{
+					// The server closed the connection, or it failed
+					this->events->remove( this->command_socket );
+					this->command_socket.close();
+
+					break;
+				}
+
+				this->replies.commit( static_cast< std::size_t >( bytes ) );
+
+				if ( static_cast< std::size_t >( bytes ) < size )
+				{
+					break;
+				}
+			}
+		}
+
+		if ( this->is_transfer_started() )
+		{
+			this->advance_transfer();
+		}
+	}
+
+	// Sends command lines whole. An attached session waits for its
+	// non-blocking socket to take them, running the reactor meanwhile.
+	bool
+	ftp_processor::send_command_buffers(
+		IOVEC* buffers,
+		std::size_t buffer_count )
+	{
+		while ( this->is_connected() )
+		{
+			this->command_socket.send_message_all( buffers, buffer_count );
+
+			std::size_t remaining = 0;
+
+			for ( std::size_t idx = 0; idx < buffer_count; ++idx )
+			{
+			#ifdef __linux__
+				remaining += buffers[idx].iov_len;
+			#elif _WIN32
+				remaining += buffers[idx].len;
+			#endif
+			}
+
+			if ( remaining == 0 )
+			{
+				return true;
+			}
+
+			if ( !this->is_attached() || !this->wait_command_writable() )
+			{
+				break;
+			}
+		}
+
+		return false;
+	}
+
+	// Runs the reactor until the command socket of the attached session
+	// can take more bytes
+	bool
+	ftp_processor::wait_command_writable()
+	{
+		this->command_writable = false;
+
+		if ( !this->events->modify( this->command_socket, reactor::readable | reactor::writable ) )
 		{
-			std::fill( std::begin( this->message ), std::end( this->message ), 0 );
+			return false;
+		}
+
+		while ( !this->command_writable && this->is_connected() )
+		{
+			if ( this->events->poll( -1 ) == -1 )
+			{
+				break;
+			}
+		}
+
+		return this->command_writable &&
+			this->events->modify( this->command_socket, reactor::readable );
+	}
+
+	// Moves the started transfer on with the replies received: the passive
+	// port, then the replies to the transfer command, or those to ABOR once
+	// it failed. The transfer ends once both its data connection and its
+	// completion reply have.
+	void
+	ftp_processor::advance_transfer()
+	{
+		// Expected NOOP reply
+		static constexpr auto NOOP_OK = 200;
+
+		reply_view reply;
+
+		// A cancellation fails the transfer at its next event
+		if ( ( this->cancel_requested != 0 ) && ( this->started->step != transfer_step::aborting ) )
+		{
+			this->fail_started_transfer();
+		}
+
+		while ( this->is_transfer_started() && this->replies.next( reply ) )
+		{
+			this->keep_reply( reply );
+
+			auto& transfer = *this->started;
 
-			if ( this->command_socket.receive_message( static_cast< void* >( this->message.data() ), strlen( this->message.data() ) ) )
+			switch ( transfer.step )
 			{
-				// Check reply
-				auto position = 0;
-				const auto maximum_position = static_cast< int >( strlen( this->message.data() ) ) - 5;
+			case transfer_step::passive:
+				if ( this->parse_pasv_reply() )
+				{
+					// The command that worked is used first from then on
+					if ( transfer.passive_fallback )
+					{
+						set_extended_passive_refused( this->host_address, this->server_endpoint.get_port(), transfer.passive_command == ftp_verb::PASV );
+					}
 
-				std::cout << this->message.data();
-				while ( ( position < maximum_position ) &&
-						( ( this->message.data()[position + 0] == '-' ) ||
-						( ( this->message.data()[position + 1] == ' ' ) &&
-						( this->message.data()[position + 2] == ' ' ) &&
-						( this->message.data()[position + 3] == ' ' ) ) ) )
+					if ( !this->connect_started_transfer() )
+					{
+						this->fail_started_transfer();
+					}
+				}
+				// Only a refusal gets the other command; PASV cannot reach IPv6 servers
+				else if ( !transfer.passive_fallback &&
+						  ( reply.code >= 500 ) &&
+						  !( ( transfer.passive_command == ftp_verb::EPSV ) && ( this->server_endpoint.get_family() == AF_INET6 ) ) )
 				{
-					// Skip continuation lines (denoted by dash or spaces)
-					const auto length = maximum_position - position;
+					transfer.passive_fallback = true;
+					transfer.passive_command = ( transfer.passive_command == ftp_verb::EPSV ) ? ftp_verb::PASV : ftp_verb::EPSV;
 
-					for ( int idx = 0; idx < length; ++idx )
+					if ( !this->send_command_line( transfer.passive_command ) )
 					{
-						if ( this->message.data()[position + idx] == 0x00 )
-						{
-							return true;
-						}
-						else if ( this->message.data()[position + idx] == 0x0A )
-						{
-							position = idx + 1;
-						}
+						this->fail_started_transfer();
+					}
+				}
+				else
+				{
+					this->fail_started_transfer();
+				}
+				break;
+
+			case transfer_step::connecting:
+				// Nothing is expected before the transfer command
+				this->fail_started_transfer();
+				break;
+
+			case transfer_step::transferring:
+				if ( reply.is_preliminary() )
+				{
+					transfer.announced_bytes = parse_transfer_size( this->reply_text.data() );
+				}
+				else
+				{
+					transfer.completed = true;
+
+					// A refused transfer sends no data
+					if ( !reply.is_positive() )
+					{
+						this->end_started_data();
 					}
 				}
+				break;
+
+			case transfer_step::aborting:
+				if ( reply.code == NOOP_OK )
+				{
+					this->finish_started_transfer( false );
+				}
+				break;
+			}
+		}
+
+		if ( !this->is_transfer_started() )
+		{
+			return;
+		}
+
+		auto& transfer = *this->started;
+
+		if ( !this->is_connected() )
+		{
+			this->end_started_data();
+			this->finish_started_transfer( false );
+		}
+		else if ( ( transfer.step == transfer_step::transferring ) && transfer.completed && transfer.data_done )
+		{
+			// The completion reply is the last reply kept
+			this->finish_started_transfer( transfer.data_succeeded && this->is_transfer_complete( transfer.bytes, transfer.announced_bytes ) );
+		}
+	}
+
+	// Starts connecting the data socket to the passive port, and registers
+	// it to learn when the connection completes
+	bool
+	ftp_processor::connect_started_transfer()
+	{
+		this->data_socket = this->data_socket_pool.acquire( this->server_endpoint.get_family() );
+
+		auto data_endpoint = this->server_endpoint;
+		data_endpoint.set_port( this->data_port );
+
+		if ( !this->data_socket.start_connect_client_socket( data_endpoint ) )
+		{
+			return false;
+		}
+
+		if ( !this->events->add( this->data_socket, reactor::writable, [this]( std::uint32_t ready )
+		{
+			this->handle_data_events( ready );
+		} ) )
+		{
+			this->data_socket.close();
+
+			return false;
+		}
+
+		this->started->step = transfer_step::connecting;
+
+		return true;
+	}
+
+	// Completes the data connection and sends the transfer command, then
+	// moves the data as the data socket is ready
+	void
+	ftp_processor::handle_data_events( std::uint32_t ready )
+	{
+		if ( !this->is_transfer_started() )
+		{
+			return;
+		}
+
+		auto& transfer = *this->started;
+
+		if ( transfer.step == transfer_step::connecting )
+		{
+			if ( ( this->cancel_requested != 0 ) ||
+				 !this->data_socket.finish_connect_client_socket() ||
+				 !this->events->modify( this->data_socket, this->sending_data ? reactor::writable : reactor::readable ) )
+			{
+				this->fail_started_transfer();
+				return;
+			}
+
+			this->encoder.clear();
+
+			if ( !this->encoder.append( transfer.command, transfer.filename ) )
+			{
+				this->fail_started_transfer();
+				return;
+			}
+
+			auto buffer = make_buffer( this->encoder.data(), this->encoder.size() );
+
+			// Sending may run the reactor, which must find the new step
+			transfer.step = transfer_step::transferring;
+
+			if ( !this->send_command_buffers( &buffer, 1 ) && this->is_transfer_started() )
+			{
+				this->fail_started_transfer();
+			}
+
+			return;
+		}
+
+		if ( ( transfer.step != transfer_step::transferring ) || transfer.data_done )
+		{
+			return;
+		}
+
+		if ( ( ready & reactor::error ) ||
+			 !( this->sending_data ? this->send_started_transfer() : this->receive_started_transfer() ) )
+		{
+			this->fail_started_transfer();
+			return;
+		}
+
+		this->advance_transfer();
+	}
+
+	// Receives what the data socket has ready into the file; the end of
+	// the stream ends the data connection. Returns false on failure.
+	bool
+	ftp_processor::receive_started_transfer()
+	{
+	#ifdef __linux__
+		auto& transfer = *this->started;
+
+		while ( this->cancel_requested == 0 )
+		{
+			const auto bytes = this->data_socket.receive_message( transfer.buffer.data(), transfer.buffer.size() );
+
+			if ( bytes == socket::WOULD_BLOCK )
+			{
+				return true;
+			}
+
+			if ( bytes == 0 )
+			{
+				transfer.data_succeeded = true;
+				this->end_started_data();
+
+				return true;
+			}
+
+			if ( bytes < 0 )
+			{
+				return false;
+			}
+
+			for ( std::size_t written = 0; written < static_cast< std::size_t >( bytes ); )
+			{
+				const auto count = ::write( transfer.file_handle, transfer.buffer.data() + written, static_cast< std::size_t >( bytes ) - written );
+
+				if ( count <= 0 )
+				{
+					return false;
+				}
+
+				written += static_cast< std::size_t >( count );
+			}
+
+			transfer.bytes += bytes;
+
+			if ( static_cast< std::size_t >( bytes ) < transfer.buffer.size() )
+			{
+				return true;
+			}
+		}
+	#endif
+
+		return false;
+	}
+
+	// Sends the file until the data socket takes no more; the end of the
+	// file closes the data connection, which completes the upload.
+	// Returns false on failure.
+	bool
+	ftp_processor::send_started_transfer()
+	{
+	#ifdef __linux__
+		auto& transfer = *this->started;
+
+		while ( this->cancel_requested == 0 )
+		{
+			if ( transfer.buffer_start == transfer.buffer_end )
+			{
+				const auto bytes = ::read( transfer.file_handle, transfer.buffer.data(), transfer.buffer.size() );
+
+				if ( bytes < 0 )
+				{
+					return false;
+				}
 
-				if ( position < maximum_position )
+				if ( bytes == 0 )
 				{
-					// FTP Error Threshold
-					static constexpr auto error_threshold = 400;
+					transfer.data_succeeded = true;
+					this->end_started_data();
 
-					return std::atoi( static_cast< char const * >( &this->message.data()[position] ) ) < error_threshold;
+					return true;
 				}
+
+				transfer.buffer_start = 0;
+				transfer.buffer_end = static_cast< std::size_t >( bytes );
+			}
+
+			const auto bytes = this->data_socket.send_message( transfer.buffer.data() + transfer.buffer_start, transfer.buffer_end - transfer.buffer_start );
+
+			if ( bytes == socket::WOULD_BLOCK )
+			{
+				return true;
 			}
+
+			if ( bytes <= 0 )
+			{
+				return false;
+			}
+
+			transfer.buffer_start += static_cast< std::size_t >( bytes );
+			transfer.bytes += bytes;
 		}
+	#endif
 
 		return false;
 	}
 
+	// Unregisters and closes the data socket of the started transfer
+	void
+	ftp_processor::end_started_data()
+	{
+		if ( this->data_socket.is_connected() )
+		{
+			this->events->remove( this->data_socket );
+			this->data_socket.close();
+
+			// Prepare the next data socket while the server completes this transfer
+			this->data_socket_pool.fill( this->server_endpoint.get_family() );
+		}
+
+		this->started->data_done = true;
+	}
+
+	// Fails the started transfer. Its data connection is closed and, unless
+	// it completed already, it is aborted as by abort_transfer, without
+	// waiting: the replies are drained as they arrive.
+	void
+	ftp_processor::fail_started_transfer()
+	{
+		auto& transfer = *this->started;
+
+		transfer.data_succeeded = false;
+		this->end_started_data();
+
+		if ( transfer.step == transfer_step::aborting )
+		{
+			return;
+		}
+
+		if ( transfer.completed || !this->send_abort() )
+		{
+			this->finish_started_transfer( false );
+
+			return;
+		}
+
+		transfer.step = transfer_step::aborting;
+	}
+
+	// Ends the started transfer and calls its handler, which may start
+	// the next one
+	void
+	ftp_processor::finish_started_transfer( bool succeeded )
+	{
+	#ifdef __linux__
+		const auto transfer = std::move( this->started );
+
+		::close( transfer->file_handle );
+
+		this->transfer_open = 0;
+		this->cancel_requested = 0;
+
+		if ( succeeded )
+		{
+			this->transferred_bytes = transfer->bytes;
+		}
+
+		if ( transfer->handler )
+		{
+			transfer->handler( succeeded );
+		}
+	#else
+		static_cast< void >( succeeded );
+	#endif
+	}
+
 	std::string
 	ftp_processor::get_host_address() const noexcept
 	{
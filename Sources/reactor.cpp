@@ -0,0 +1,266 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "reactor.hpp"
+
+#ifdef __linux__
+	#include <sys/epoll.h>
+	#include <errno.h>
+	#include <unistd.h>
+#endif
+
+#include <array>
+#include <iostream>
+#include <utility>
+
+namespace networking
+{
+#ifdef __linux__
+	// Translates reactor events to epoll events
+	static std::uint32_t
+	to_epoll_events( std::uint32_t events ) noexcept
+	{
+		std::uint32_t epoll_events = 0;
+
+		if ( events & reactor::readable )
+		{
+			epoll_events |= EPOLLIN | EPOLLRDHUP;
+		}
+
+		if ( events & reactor::writable )
+		{
+			epoll_events |= EPOLLOUT;
+		}
+
+		return epoll_events;
+	}
+
+	// Translates epoll events to reactor events
+	static std::uint32_t
+	from_epoll_events( std::uint32_t epoll_events ) noexcept
+	{
+		std::uint32_t events = 0;
+
+		if ( epoll_events & EPOLLIN )
+		{
+			events |= reactor::readable;
+		}
+
+		if ( epoll_events & EPOLLOUT )
+		{
+			events |= reactor::writable;
+		}
+
+		if ( epoll_events & EPOLLERR )
+		{
+			events |= reactor::error;
+		}
+
+		if ( epoll_events & ( EPOLLHUP | EPOLLRDHUP ) )
+		{
+			events |= reactor::hangup;
+		}
+
+		return events;
+	}
+#endif
+
+	reactor::reactor() noexcept
+	{
+	#ifdef __linux__
+		this->poll_handle = ::epoll_create1( EPOLL_CLOEXEC );
+
+		if ( this->poll_handle == -1 )
+		{
+			std::cerr << "Cannot create the event poll.";
+		}
+	#endif
+	}
+
+	reactor::~reactor() noexcept
+	{
+	#ifdef __linux__
+		if ( this->is_open() )
+		{
+			::close( this->poll_handle );
+		}
+	#endif
+	}
+
+	bool
+	reactor::is_open() const noexcept
+	{
+		return ( this->poll_handle != -1 );
+	}
+
+	// Returns the number of registered sockets
+	std::size_t
+	reactor::size() const noexcept
+	{
+		return this->handlers.size();
+	}
+
+	// Registers a connected socket for the given events.
+	// The socket is switched to non-blocking mode, and must be removed
+	// from the reactor before it is closed.
+	bool
+	reactor::add(
+		socket& target,
+		std::uint32_t events,
+		handler callback )
+	{
+	#ifdef __linux__
+		if ( this->is_open() && target.is_connected() && callback && target.set_blocking( false ) )
+		{
+			// Every handler may be removed during a single dispatch;
+			// reserving room for them now keeps remove() from allocating
+			this->removed_handlers.reserve( this->removed_handlers.size() + this->handlers.size() + 1 );
+
+			epoll_event poll_event = {};
+
+			poll_event.events = to_epoll_events( events );
+			poll_event.data.fd = target.get_handle();
+
+			if ( ::epoll_ctl( this->poll_handle, EPOLL_CTL_ADD, target.get_handle(), &poll_event ) == 0 )
+			{
+				this->handlers[target.get_handle()] = std::move( callback );
+
+				return true;
+			}
+
+			std::cerr << "Cannot register socket with the event poll.";
+		}
+	#else
+		static_cast< void >( target );
+		static_cast< void >( events );
+		static_cast< void >( callback );
+	#endif
+
+		return false;
+	}
+
+	// Changes the events a registered socket is waiting for
+	bool
+	reactor::modify(
+		socket const & target,
+		std::uint32_t events ) noexcept
+	{
+	#ifdef __linux__
+		if ( this->handlers.count( target.get_handle() ) != 0 )
+		{
+			epoll_event poll_event = {};
+
+			poll_event.events = to_epoll_events( events );
+			poll_event.data.fd = target.get_handle();
+
+			return ::epoll_ctl( this->poll_handle, EPOLL_CTL_MOD, target.get_handle(), &poll_event ) == 0;
+		}
+	#else
+		static_cast< void >( target );
+		static_cast< void >( events );
+	#endif
+
+		return false;
+	}
+
+	// Unregisters a socket; safe to call from within its own handler
+	bool
+	reactor::remove( socket const & target ) noexcept
+	{
+	#ifdef __linux__
+		auto removed = this->handlers.extract( target.get_handle() );
+
+		if ( !removed.empty() )
+		{
+			if ( this->dispatch_depth > 0 )
+			{
+				this->removed_handlers.push_back( std::move( removed ) );
+			}
+
+			return ::epoll_ctl( this->poll_handle, EPOLL_CTL_DEL, target.get_handle(), nullptr ) == 0;
+		}
+	#else
+		static_cast< void >( target );
+	#endif
+
+		return false;
+	}
+
+	// Waits up to the given timeout (-1 waits indefinitely) for sockets
+	// to become ready and dispatches their handlers.
+	// Returns the number of dispatched events, or -1 on failure.
+	int
+	reactor::poll( int timeout_milliseconds )
+	{
+	#ifdef __linux__
+		// Max events dispatched per wait
+		static constexpr auto max_events = 256;
+
+		std::array< epoll_event, max_events > poll_events;
+
+		const auto count = ::epoll_wait( this->poll_handle, poll_events.data(), max_events, timeout_milliseconds );
+
+		if ( count == -1 )
+		{
+			if ( errno == EINTR )
+			{
+				return 0;
+			}
+
+			std::cerr << "Failed to wait on the event poll.";
+			return -1;
+		}
+
+		// Handlers are called in place; those removed meanwhile, possibly by
+		// themselves, are destroyed once the outermost dispatch ends
+		++this->dispatch_depth;
+
+		for ( auto idx = 0; idx < count; ++idx )
+		{
+			// A previous handler may have removed this socket
+			const auto found = this->handlers.find( poll_events[idx].data.fd );
+
+			if ( found != std::end( this->handlers ) )
+			{
+				found->second( from_epoll_events( poll_events[idx].events ) );
+			}
+		}
+
+		if ( --this->dispatch_depth == 0 )
+		{
+			this->removed_handlers.clear();
+		}
+
+		return count;
+	#else
+		static_cast< void >( timeout_milliseconds );
+
+		return -1;
+	#endif
+	}
+
+	// Dispatches events until stopped or until no socket is left
+	void
+	reactor::run()
+	{
+		this->running = true;
+
+		while ( this->running && !this->handlers.empty() )
+		{
+			if ( this->poll( -1 ) == -1 )
+			{
+				break;
+			}
+		}
+
+		this->running = false;
+	}
+
+	void
+	reactor::stop() noexcept
+	{
+		this->running = false;
+	}
+}
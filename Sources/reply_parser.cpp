@@ -0,0 +1,327 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "reply_parser.hpp"
+
+#include <cstring>
+
+namespace networking
+{
+	// Length of a reply code
+	static constexpr std::size_t CODE_LENGTH = 3;
+
+	// Returns the code starting a line, or 0 if it does not start with one
+	static int
+	parse_code( char const * line ) noexcept
+	{
+		int code = 0;
+
+		for ( std::size_t idx = 0; idx < CODE_LENGTH; ++idx )
+		{
+			if ( ( line[idx] < '0' ) || ( line[idx] > '9' ) )
+			{
+				return 0;
+			}
+
+			code = code * 10 + ( line[idx] - '0' );
+		}
+
+		return code;
+	}
+
+	reply_view::line_range::iterator::iterator( std::string_view remaining ) noexcept :
+		remaining( remaining )
+	{
+		this->find_line();
+	}
+
+	reply_view::line_range::iterator::reference
+	reply_view::line_range::iterator::operator*() const noexcept
+	{
+		return this->line;
+	}
+
+	reply_view::line_range::iterator::pointer
+	reply_view::line_range::iterator::operator->() const noexcept
+	{
+		return &this->line;
+	}
+
+	reply_view::line_range::iterator&
+	reply_view::line_range::iterator::operator++() noexcept
+	{
+		const auto line_end = this->remaining.find( '\n' );
+
+		this->remaining.remove_prefix( ( line_end == std::string_view::npos ) ? this->remaining.size() : line_end + 1 );
+		this->find_line();
+
+		return *this;
+	}
+
+	reply_view::line_range::iterator
+	reply_view::line_range::iterator::operator++( int ) noexcept
+	{
+		auto previous = *this;
+
+		++( *this );
+
+		return previous;
+	}
+
+	bool
+	reply_view::line_range::iterator::operator==( iterator const & other ) const noexcept
+	{
+		return this->remaining.data() == other.remaining.data();
+	}
+
+	bool
+	reply_view::line_range::iterator::operator!=( iterator const & other ) const noexcept
+	{
+		return !( *this == other );
+	}
+
+	// Makes the line the first of the remaining text, without its line ending
+	void
+	reply_view::line_range::iterator::find_line() noexcept
+	{
+		this->line = this->remaining.substr( 0, this->remaining.find( '\n' ) );
+
+		if ( !this->line.empty() && ( this->line.back() == '\r' ) )
+		{
+			this->line.remove_suffix( 1 );
+		}
+	}
+
+	reply_view::line_range::line_range( std::string_view text ) noexcept :
+		text( text )
+	{
+	}
+
+	reply_view::line_range::iterator
+	reply_view::line_range::begin() const noexcept
+	{
+		return iterator( this->text );
+	}
+
+	reply_view::line_range::iterator
+	reply_view::line_range::end() const noexcept
+	{
+		return iterator( this->text.substr( this->text.size() ) );
+	}
+
+	reply_view::operator bool() const noexcept
+	{
+		return this->is_positive();
+	}
+
+	reply_class
+	reply_view::get_class() const noexcept
+	{
+		switch ( this->code / 100 )
+		{
+		case 1:
+			return reply_class::positive_preliminary;
+		case 2:
+			return reply_class::positive_completion;
+		case 3:
+			return reply_class::positive_intermediate;
+		case 4:
+			return reply_class::transient_negative;
+		case 5:
+			return reply_class::permanent_negative;
+		default:
+			return reply_class::none;
+		}
+	}
+
+	// Whether the reply accepts the command, at once or pending more
+	bool
+	reply_view::is_positive() const noexcept
+	{
+		const auto kind = this->get_class();
+
+		return ( kind == reply_class::positive_preliminary ) ||
+			( kind == reply_class::positive_completion ) ||
+			( kind == reply_class::positive_intermediate );
+	}
+
+	// Whether the reply only reports that the command is in progress (1xx)
+	bool
+	reply_view::is_preliminary() const noexcept
+	{
+		return ( this->code >= 100 ) && ( this->code < 200 );
+	}
+
+	reply_view::line_range
+	reply_view::lines() const noexcept
+	{
+		return line_range( this->text );
+	}
+
+	// Returns where to receive bytes, and how many fit there.
+	// The bytes received must then be committed.
+	char*
+	reply_parser::prepare( std::size_t& size ) noexcept
+	{
+		if ( this->end == CAPACITY )
+		{
+			this->make_room();
+		}
+
+		size = CAPACITY - this->end;
+
+		return this->buffer.data() + this->end;
+	}
+
+	void
+	reply_parser::commit( std::size_t size ) noexcept
+	{
+		this->end += size;
+	}
+
+	// Scans the bytes received since the last call and yields the next
+	// complete reply, if any. The reply is consumed: its text is valid until
+	// the next call to prepare.
+	// A reply whose first line starts with "xyz-" continues until a line
+	// starting with the same code and no dash.
+	bool
+	reply_parser::next( reply_view& reply ) noexcept
+	{
+		while ( true )
+		{
+			auto const * first = this->buffer.data() + this->start;
+			const auto received = this->end - this->start;
+
+			auto const * line_end = static_cast< char const * >(
+				std::memchr( first + this->scanned, '\n', received - this->scanned ) );
+
+			if ( line_end == nullptr )
+			{
+				this->scanned = received;
+
+				return false;
+			}
+
+			const auto line_start = this->line_start;
+			const auto line_length = static_cast< std::size_t >( line_end - first ) - line_start;
+
+			this->scanned = this->line_start = line_length + line_start + 1;
+
+			bool complete = false;
+
+			if ( line_start == 0 )
+			{
+				this->first_line_end = this->line_start;
+				this->code = ( line_length >= CODE_LENGTH ) ? parse_code( first ) : 0;
+
+				// A line without a code is a reply on its own
+				complete = ( this->code == 0 ) || ( line_length == CODE_LENGTH ) || ( first[CODE_LENGTH] != '-' );
+			}
+			else
+			{
+				complete = ( line_length >= CODE_LENGTH ) &&
+					( parse_code( first + line_start ) == this->code ) &&
+					( ( line_length == CODE_LENGTH ) || ( first[line_start + CODE_LENGTH] != '-' ) );
+			}
+
+			if ( complete )
+			{
+				reply.code = this->code;
+				reply.text = std::string_view( first, this->line_start );
+
+				this->start += this->line_start;
+
+				// Once all is consumed, the next bytes go to the front
+				if ( this->start == this->end )
+				{
+					this->start = 0;
+					this->end = 0;
+				}
+
+				this->scanned = 0;
+				this->line_start = 0;
+				this->first_line_end = 0;
+				this->code = 0;
+
+				return true;
+			}
+		}
+	}
+
+	// Whether bytes were received past the last reply yielded
+	bool
+	reply_parser::has_pending() const noexcept
+	{
+		return this->end > this->start;
+	}
+
+	// Drops the bytes received, as when the connection closes
+	void
+	reply_parser::clear() noexcept
+	{
+		this->start = 0;
+		this->end = 0;
+		this->scanned = 0;
+		this->line_start = 0;
+		this->first_line_end = 0;
+		this->code = 0;
+	}
+
+	// Frees the end of the buffer by moving the reply in progress to its
+	// front. A reply filling the whole buffer drops its lines between the
+	// first one and the line in progress; a line doing so drops its middle.
+	// At least one byte is always freed.
+	void
+	reply_parser::make_room() noexcept
+	{
+		if ( this->start > 0 )
+		{
+			std::memmove( this->buffer.data(), this->buffer.data() + this->start, this->end - this->start );
+
+			this->end -= this->start;
+			this->start = 0;
+
+			return;
+		}
+
+		if ( this->line_start > this->first_line_end )
+		{
+			std::memmove( this->buffer.data() + this->first_line_end, this->buffer.data() + this->line_start, this->end - this->line_start );
+
+			const auto dropped = this->line_start - this->first_line_end;
+
+			this->end -= dropped;
+			this->scanned -= dropped;
+			this->line_start = this->first_line_end;
+
+			return;
+		}
+
+		// A first line filling the buffer leaves no room for the line after
+		// it; its middle is dropped, keeping its code, separator and ending
+		if ( this->line_start + CODE_LENGTH + 2 > CAPACITY )
+		{
+			const auto ending = ( this->buffer[this->first_line_end - 2] == '\r' ) ? 2 : 1;
+			const auto tail = this->first_line_end - ending;
+			const auto dropped = tail - ( CODE_LENGTH + 1 );
+
+			std::memmove( this->buffer.data() + CODE_LENGTH + 1, this->buffer.data() + tail, this->end - tail );
+
+			this->end -= dropped;
+			this->scanned -= dropped;
+			this->line_start -= dropped;
+			this->first_line_end -= dropped;
+
+			return;
+		}
+
+		// Keep the code and separator starting the line; the rest of it is
+		// dropped until its end arrives
+		const auto kept = this->line_start + CODE_LENGTH + 1;
+
+		this->end = kept;
+		this->scanned = kept;
+	}
+}
@@ -0,0 +1,156 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "resolver.hpp"
+
+#ifdef __linux__
+	#include <netdb.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace networking
+{
+	resolver::resolver( std::chrono::seconds time_to_live ) :
+		time_to_live( time_to_live )
+	{
+	}
+
+	// Resolves the host, from the cache when possible.
+	// Returns an empty list if the host cannot be resolved.
+	std::vector< endpoint >
+	resolver::resolve(
+		std::string const & host,
+		std::uint16_t port )
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		std::vector< endpoint > endpoints;
+
+		{
+			std::lock_guard< std::mutex > lock( this->cache_mutex );
+
+			const auto found = this->cache.find( host );
+
+			if ( ( found != std::end( this->cache ) ) && ( found->second.expiry > now ) )
+			{
+				endpoints = found->second.endpoints;
+			}
+		}
+
+		if ( endpoints.empty() )
+		{
+			endpoints = lookup( host, 0 );
+
+			if ( !endpoints.empty() )
+			{
+				std::lock_guard< std::mutex > lock( this->cache_mutex );
+
+				this->cache[host] = entry { endpoints, now + this->time_to_live };
+			}
+		}
+
+		for ( auto& resolved : endpoints )
+		{
+			resolved.set_port( port );
+		}
+
+		return endpoints;
+	}
+
+	void
+	resolver::clear()
+	{
+		std::lock_guard< std::mutex > lock( this->cache_mutex );
+
+		this->cache.clear();
+	}
+
+	// Resolves the host with getaddrinfo, bypassing the cache
+	std::vector< endpoint >
+	resolver::lookup(
+		std::string const & host,
+		std::uint16_t port )
+	{
+		addrinfo hints = {};
+
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_flags = AI_ADDRCONFIG;
+
+		addrinfo* results = nullptr;
+
+		const auto error = ::getaddrinfo( host.c_str(), nullptr, &hints, &results );
+
+		if ( error != 0 )
+		{
+			std::cerr << "Cannot find hostname " << host << ": " << ::gai_strerror( error ) << std::endl;
+			return {};
+		}
+
+		// Split by family, keeping the order getaddrinfo sorted them in (RFC 6724)
+		std::vector< endpoint > preferred;
+		std::vector< endpoint > others;
+
+		for ( auto* result = results; result != nullptr; result = result->ai_next )
+		{
+			if ( ( ( result->ai_family != AF_INET ) && ( result->ai_family != AF_INET6 ) ) ||
+				 ( result->ai_addrlen > sizeof( sockaddr_storage ) ) )
+			{
+				continue;
+			}
+
+			endpoint resolved;
+
+			std::memcpy( &resolved.address, result->ai_addr, result->ai_addrlen );
+			resolved.address_length = static_cast< int >( result->ai_addrlen );
+			resolved.set_port( port );
+
+			const auto is_same = [&resolved]( endpoint const & other )
+			{
+				return ( other.address_length == resolved.address_length ) &&
+					( std::memcmp( &other.address, &resolved.address, resolved.address_length ) == 0 );
+			};
+
+			if ( std::any_of( std::begin( preferred ), std::end( preferred ), is_same ) ||
+				 std::any_of( std::begin( others ), std::end( others ), is_same ) )
+			{
+				continue;
+			}
+
+			if ( preferred.empty() || ( preferred.front().get_family() == resolved.get_family() ) )
+			{
+				preferred.push_back( resolved );
+			}
+			else
+			{
+				others.push_back( resolved );
+			}
+		}
+
+		::freeaddrinfo( results );
+
+		// Interleave the families, starting with the preferred one
+		std::vector< endpoint > endpoints;
+
+		for ( std::size_t idx = 0; ( idx < preferred.size() ) || ( idx < others.size() ); ++idx )
+		{
+			if ( idx < preferred.size() )
+			{
+				endpoints.push_back( preferred[idx] );
+			}
+
+			if ( idx < others.size() )
+			{
+				endpoints.push_back( others[idx] );
+			}
+		}
+
+		return endpoints;
+	}
+}
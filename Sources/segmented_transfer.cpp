@@ -0,0 +1,458 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "segmented_transfer.hpp"
+#include "ftp_processor.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace networking
+{
+	segmented_transfer::segment::segment(
+		std::int64_t position,
+		std::int64_t end ) noexcept :
+		position( position ),
+		end( end )
+	{
+	}
+
+	segmented_transfer::segmented_transfer(
+		ftp_processor& origin,
+		std::size_t session_count ) :
+		origin( origin ),
+		session_count( std::max< std::size_t >( session_count, 1 ) )
+	{
+	}
+
+	// Downloads the remote file, of the size reported by the server, into
+	// the local file, which is created with that size up front so that
+	// every session writes in place.
+	// Returns false if part of the file could not be retrieved.
+	bool
+	segmented_transfer::download(
+		std::string const & remote_filename,
+		std::string const & local_filename,
+		std::int64_t file_size )
+	{
+	#ifdef __linux__
+		const auto file_handle = ::open( local_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+		if ( file_handle == -1 )
+		{
+			return false;
+		}
+
+		if ( ::ftruncate( file_handle, file_size ) != 0 )
+		{
+			::close( file_handle );
+
+			return false;
+		}
+
+		this->uploading = false;
+		this->split_file( file_size );
+
+		const auto success = this->run( remote_filename, file_handle, nullptr );
+
+		::close( file_handle );
+
+		return success;
+	#else
+		static_cast< void >( remote_filename );
+		static_cast< void >( local_filename );
+		static_cast< void >( file_size );
+
+		return false;
+	#endif
+	}
+
+	// Uploads the local file into the remote file. The server must support
+	// restarted STOR commands (REST STREAM).
+	// Returns false if part of the file could not be sent.
+	bool
+	segmented_transfer::upload(
+		std::string const & local_filename,
+		std::string const & remote_filename,
+		std::int64_t file_size )
+	{
+	#ifdef __linux__
+		const auto file_handle = ::open( local_filename.c_str(), O_RDONLY | O_CLOEXEC );
+
+		if ( file_handle == -1 )
+		{
+			return false;
+		}
+
+		this->uploading = true;
+		this->split_file( file_size );
+
+		// A STOR without restart offset truncates the remote file, so the
+		// first segment is opened before any other session writes to it
+		auto* first = this->next_segment();
+
+		if ( !this->origin.open_upload( remote_filename, 0, false ) )
+		{
+			this->release_segment( *first );
+
+			::close( file_handle );
+
+			return false;
+		}
+
+		const auto success = this->run( remote_filename, file_handle, first );
+
+		::close( file_handle );
+
+		return success;
+	#else
+		static_cast< void >( local_filename );
+		static_cast< void >( remote_filename );
+		static_cast< void >( file_size );
+
+		return false;
+	#endif
+	}
+
+	// Returns the number of bytes moved by the last transfer
+	std::int64_t
+	segmented_transfer::get_transferred_bytes() const noexcept
+	{
+		return this->transferred_bytes;
+	}
+
+	// Splits the file into one segment per session; small files are not
+	// worth the additional sessions.
+	void
+	segmented_transfer::split_file( std::int64_t file_size )
+	{
+		// Further sessions start in the login directory. Queried now,
+		// while the origin session has no transfer open.
+		this->directory.clear();
+		this->origin.get_working_directory( this->directory );
+
+		const auto segment_count = std::max< std::int64_t >(
+			std::min< std::int64_t >( static_cast< std::int64_t >( this->session_count ), file_size / MINIMUM_SEGMENT_SIZE ), 1 );
+
+		this->segments.clear();
+		this->pending_segments.clear();
+		this->transferred_bytes = 0;
+
+		for ( std::int64_t idx = 0; idx < segment_count; ++idx )
+		{
+			this->segments.emplace_back(
+				file_size * idx / segment_count,
+				file_size * ( idx + 1 ) / segment_count );
+		}
+
+		// Taken from the back, so the origin session starts at the beginning
+		for ( auto it = this->segments.rbegin(); it != this->segments.rend(); ++it )
+		{
+			this->pending_segments.push_back( &*it );
+		}
+	}
+
+	// Opens the additional sessions and transfers the segments over all of
+	// them. The origin session may have a segment opened already.
+	bool
+	segmented_transfer::run(
+		std::string const & remote_filename,
+		int file_handle,
+		segment* opened_segment )
+	{
+		std::vector< std::thread > threads;
+
+		for ( std::size_t idx = 1; idx < this->segments.size(); ++idx )
+		{
+			threads.emplace_back( [this, &remote_filename, file_handle]()
+			{
+				ftp_processor session;
+
+				// A session that cannot log in leaves its segment to the others
+				if ( session.connect_session( this->origin, this->directory ) )
+				{
+					this->run_session( session, remote_filename, file_handle, nullptr );
+				}
+
+				session.terminate();
+			} );
+		}
+
+		this->run_session( this->origin, remote_filename, file_handle, opened_segment );
+
+		for ( auto& thread : threads )
+		{
+			thread.join();
+		}
+
+		return this->pending_segments.empty();
+	}
+
+	// Transfers segments over one session until none is left.
+	// A session that fails gives its segment back and stops.
+	void
+	segmented_transfer::run_session(
+		ftp_processor& session,
+		std::string const & remote_filename,
+		int file_handle,
+		segment* opened_segment )
+	{
+		static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+
+		std::vector< char > buffer( BUFFER_SIZE );
+
+		for ( auto* current = ( opened_segment != nullptr ) ? opened_segment : this->next_segment();
+			  current != nullptr;
+			  current = this->next_segment() )
+		{
+			const auto success = this->uploading ?
+				this->upload_segment( session, *current, remote_filename, file_handle, buffer, current == opened_segment ) :
+				this->download_segment( session, *current, remote_filename, file_handle, buffer );
+
+			this->release_segment( *current );
+
+			if ( !success )
+			{
+				break;
+			}
+		}
+	}
+
+	// Retrieves a segment, stopping the server once its end is reached.
+	// The end may be lowered meanwhile by a session taking over part of it.
+	bool
+	segmented_transfer::download_segment(
+		ftp_processor& session,
+		segment& current,
+		std::string const & remote_filename,
+		int file_handle,
+		std::vector< char >& buffer )
+	{
+	#ifdef __linux__
+		auto position = current.position.load();
+
+		if ( position >= current.end.load() )
+		{
+			return true;
+		}
+
+		if ( !session.open_download( remote_filename, position ) )
+		{
+			return false;
+		}
+
+		bool written = true;
+
+		for ( auto remaining = current.end.load() - position; remaining > 0; remaining = current.end.load() - position )
+		{
+			const auto bytes = session.receive_data( buffer.data(), static_cast< std::size_t >( std::min< std::int64_t >( remaining, buffer.size() ) ) );
+
+			if ( bytes <= 0 )
+			{
+				break;
+			}
+
+			// Bytes past a lowered end duplicate those of the other session
+			for ( auto offset = 0; offset < bytes; )
+			{
+				const auto count = ::pwrite( file_handle, buffer.data() + offset, static_cast< std::size_t >( bytes - offset ), position + offset );
+
+				if ( count <= 0 )
+				{
+					written = false;
+
+					break;
+				}
+
+				offset += static_cast< int >( count );
+			}
+
+			if ( !written )
+			{
+				break;
+			}
+
+			this->transferred_bytes += std::min< std::int64_t >( bytes, std::max< std::int64_t >( current.end.load() - position, 0 ) );
+
+			position += bytes;
+			current.position = position;
+		}
+
+		// Closing the data connection early cancels the rest of the file;
+		// the server then reports the cancellation, which is consumed here.
+		// Once the whole segment is written, that report is expected and
+		// the session goes on with the next one.
+		const auto complete = written && ( position >= current.end.load() );
+		const auto replied = session.close_transfer( complete );
+
+		return complete && replied;
+	#else
+		static_cast< void >( session );
+		static_cast< void >( current );
+		static_cast< void >( remote_filename );
+		static_cast< void >( file_handle );
+		static_cast< void >( buffer );
+
+		return false;
+	#endif
+	}
+
+	// Sends a segment, closing the data connection once its end is reached.
+	// The end may be lowered meanwhile by a session taking over part of it.
+	bool
+	segmented_transfer::upload_segment(
+		ftp_processor& session,
+		segment& current,
+		std::string const & remote_filename,
+		int file_handle,
+		std::vector< char >& buffer,
+		bool opened )
+	{
+	#ifdef __linux__
+		auto position = current.position.load();
+		const auto initial_end = current.end.load();
+
+		if ( !opened )
+		{
+			if ( position >= current.end.load() )
+			{
+				return true;
+			}
+
+			// Restarting at the beginning would truncate what the other
+			// sessions have sent
+			if ( ( position == 0 ) || !session.open_upload( remote_filename, position, false ) )
+			{
+				return false;
+			}
+		}
+
+		bool sent = true;
+
+		for ( auto remaining = current.end.load() - position; remaining > 0; remaining = current.end.load() - position )
+		{
+			const auto bytes = ::pread( file_handle, buffer.data(), static_cast< std::size_t >( std::min< std::int64_t >( remaining, buffer.size() ) ), position );
+
+			if ( bytes <= 0 )
+			{
+				sent = false;
+
+				break;
+			}
+
+			// Bytes past a lowered end duplicate those of the other session
+			for ( auto offset = 0; offset < bytes; )
+			{
+				const auto count = session.send_data( buffer.data() + offset, static_cast< std::size_t >( bytes - offset ) );
+
+				if ( count <= 0 )
+				{
+					sent = false;
+
+					break;
+				}
+
+				offset += count;
+			}
+
+			if ( !sent )
+			{
+				break;
+			}
+
+			this->transferred_bytes += std::min< std::int64_t >( bytes, std::max< std::int64_t >( current.end.load() - position, 0 ) );
+
+			position += bytes;
+			current.position = position;
+		}
+
+		// The server stores what it received once the data connection
+		// closes. Closing it at a lowered end, with the segment sent, may
+		// still be reported as a cancellation; the session then goes on
+		// with the next segment.
+		const auto replied = session.close_transfer( sent && ( current.end.load() < initial_end ) && ( position >= current.end.load() ) );
+
+		return sent && replied;
+	#else
+		static_cast< void >( session );
+		static_cast< void >( current );
+		static_cast< void >( remote_filename );
+		static_cast< void >( file_handle );
+		static_cast< void >( buffer );
+		static_cast< void >( opened );
+
+		return false;
+	#endif
+	}
+
+	// Hands out a pending segment or, failing that, the back half of the
+	// segment in progress with the most bytes left, if large enough.
+	// Returns nullptr once there is nothing left to take.
+	segmented_transfer::segment*
+	segmented_transfer::next_segment()
+	{
+		std::lock_guard< std::mutex > lock( this->segments_mutex );
+
+		if ( !this->pending_segments.empty() )
+		{
+			auto* current = this->pending_segments.back();
+			this->pending_segments.pop_back();
+
+			current->active = true;
+
+			return current;
+		}
+
+		segment* largest = nullptr;
+		std::int64_t largest_remaining = 0;
+
+		for ( auto& current : this->segments )
+		{
+			const auto remaining = current.end.load() - current.position.load();
+
+			if ( current.active && ( remaining > largest_remaining ) )
+			{
+				largest = &current;
+				largest_remaining = remaining;
+			}
+		}
+
+		if ( ( largest == nullptr ) || ( largest_remaining < 2 * MINIMUM_SEGMENT_SIZE ) )
+		{
+			return nullptr;
+		}
+
+		const auto end = largest->end.load();
+		const auto middle = end - largest_remaining / 2;
+
+		largest->end = middle;
+
+		this->segments.emplace_back( middle, end );
+
+		auto& split = this->segments.back();
+		split.active = true;
+
+		return &split;
+	}
+
+	// Returns a segment given up before its end to the pending segments
+	void
+	segmented_transfer::release_segment( segment& current )
+	{
+		std::lock_guard< std::mutex > lock( this->segments_mutex );
+
+		current.active = false;
+
+		if ( current.position.load() < current.end.load() )
+		{
+			this->pending_segments.push_back( &current );
+		}
+	}
+}
@@ -4,6 +4,7 @@
  */
 
 #include "socket.hpp"
+#include "resolver.hpp"
 
 #ifdef __linux__
 	#include <sys/socket.h>
@@ -12,127 +13,927 @@
 	#include <netdb.h>
 	#include <unistd.h>
 	#include <netinet/tcp.h>
+	#include <sys/sendfile.h>
+	#include <linux/errqueue.h>
+	#include <poll.h>
+	#include <fcntl.h>
+	#include <errno.h>
 
 	using SOCKADDR = struct sockaddr;
-	using SOCKADDR_IN = struct sockaddr_in;
-	using LPHOSTENT = struct hostent*;
-	using LPIN_ADDR = struct in_addr*;
+	using SOCKLEN = socklen_t;
 
 	static constexpr auto SOCKET_ERROR = -1;
 	static constexpr auto INVALID_SOCKET = -1;
 #elif _WIN32
 	#include <WinSock2.h>
+
+	using SOCKLEN = int;
 #endif
 
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace networking
+{
+	// Closes a raw socket handle
+	static void
+	close_handle( SOCKET handle ) noexcept
+	{
+	#ifdef __linux__
+		::close( handle );
+	#elif _WIN32
+		::closesocket( handle );
+	#endif
+	}
+
+	// Switches a raw socket handle between blocking and non-blocking mode
+	static bool
+	set_handle_blocking(
+		SOCKET handle,
+		bool blocking ) noexcept
+	{
+	#ifdef __linux__
+		const auto flags = ::fcntl( handle, F_GETFL, 0 );
+
+		if ( ( flags == SOCKET_ERROR ) ||
+			 ( ::fcntl( handle, F_SETFL, blocking ? ( flags & ~O_NONBLOCK ) : ( flags | O_NONBLOCK ) ) == SOCKET_ERROR ) )
+		{
+			std::cerr << "Cannot change socket blocking mode.";
+			return false;
+		}
+	#elif _WIN32
+		u_long mode = blocking ? 0 : 1;
+
+		if ( ::ioctlsocket( handle, FIONBIO, &mode ) == SOCKET_ERROR )
+		{
+			std::cerr << "Cannot change socket blocking mode.";
+			return false;
+		}
+	#endif
+
+		return true;
+	}
+
+	// Checks whether a failed non-blocking connect is still in progress
+	static bool
+	is_connect_pending() noexcept
+	{
+	#ifdef __linux__
+		return errno == EINPROGRESS;
+	#elif _WIN32
+		return ::WSAGetLastError() == WSAEWOULDBLOCK;
+	#endif
+	}
+
+	// Waits for events on the handles, resuming when interrupted
+	static int
+	poll_handles(
+		pollfd* handles,
+		std::size_t count,
+		int timeout_milliseconds ) noexcept
+	{
+	#ifdef __linux__
+		int result = 0;
+
+		do
+		{
+			result = ::poll( handles, count, timeout_milliseconds );
+		}
+		while ( ( result == SOCKET_ERROR ) && ( errno == EINTR ) );
+
+		return result;
+	#elif _WIN32
+		return ::WSAPoll( handles, static_cast< ULONG >( count ), timeout_milliseconds );
+	#endif
+	}
+
+	// Sets a kernel buffer size (SO_RCVBUF/SO_SNDBUF) and reads it back.
+	// Returns false if the system clamped it below the request (e.g. to
+	// net.core.rmem_max): the buffer is then locked at a size smaller than
+	// the automatic tuning would have grown it to. A refused size leaves
+	// the default, and tuning, in place.
+	static bool
+	set_buffer_size(
+		SOCKET handle,
+		int name,
+		int size ) noexcept
+	{
+		if ( ::setsockopt( handle, SOL_SOCKET, name, reinterpret_cast< char const * >( &size ), sizeof( size ) ) == SOCKET_ERROR )
+		{
+			return true;
+		}
+
+		int effective = 0;
+		SOCKLEN effective_length = sizeof( effective );
+
+		if ( ::getsockopt( handle, SOL_SOCKET, name, reinterpret_cast< char* >( &effective ), &effective_length ) == SOCKET_ERROR )
+		{
+			return false;
+		}
+
+	#ifdef __linux__
+		// Linux reports twice the size set, the other half being bookkeeping
+		effective /= 2;
+	#endif
+
+		return effective >= size;
+	}
+
+	// Returns the size of a scatter/gather buffer
+	static std::size_t
+	buffer_length( IOVEC const & buffer ) noexcept
+	{
+	#ifdef __linux__
+		return buffer.iov_len;
+	#elif _WIN32
+		return buffer.len;
+	#endif
+	}
+
+	// Advances a scatter/gather buffer past its first bytes
+	static void
+	advance_buffer(
+		IOVEC& buffer,
+		std::size_t size ) noexcept
+	{
+	#ifdef __linux__
+		buffer.iov_base = static_cast< char* >( buffer.iov_base ) + size;
+		buffer.iov_len -= size;
+	#elif _WIN32
+		buffer.buf += size;
+		buffer.len -= static_cast< ULONG >( size );
+	#endif
+	}
+
+	socket_profile
+	socket_profile::control()
+	{
+		socket_profile profile;
+
+		profile.no_delay = true;
+		profile.quick_ack = true;
+
+		return profile;
+	}
+
+	// Kernel buffers are left to the automatic tuning unless a size is given,
+	// e.g. 4 MiB for a 10 Gb/s link with about 3 ms of RTT
+	socket_profile
+	socket_profile::bulk(
+		std::string const & congestion_control,
+		int buffer_size )
+	{
+		// Keeps the send queue short without starving the link
+		static constexpr auto not_sent_low_water_mark = 128 * 1024;
+		// Wakes receivers for large chunks only
+		static constexpr auto receive_low_water_mark = 64 * 1024;
+
+		socket_profile profile;
+
+		profile.receive_buffer_size = buffer_size;
+		profile.send_buffer_size = buffer_size;
+		profile.not_sent_low_water_mark = not_sent_low_water_mark;
+		profile.receive_low_water_mark = receive_low_water_mark;
+		profile.congestion_control = congestion_control;
+
+		return profile;
+	}
+
+	socket::~socket() noexcept
+	{
+		this->close();
+		this->release_prepared();
+	}
+
+	socket::socket( socket&& other ) noexcept :
+		socket_handle( other.socket_handle ),
+		prepared_handle( other.prepared_handle ),
+		prepared_family( other.prepared_family ),
+		blocking( other.blocking ),
+		zero_copy( other.zero_copy ),
+		profile( std::move( other.profile ) ),
+		policy( other.policy ),
+		metrics( other.metrics )
+	{
+		other.socket_handle = INVALID_SOCKET;
+		other.prepared_handle = INVALID_SOCKET;
+		other.blocking = true;
+		other.zero_copy = zero_copy_state::unknown;
+	}
+
+	socket&
+	socket::operator=( socket&& other ) noexcept
+	{
+		if ( this != &other )
+		{
+			this->close();
+			this->release_prepared();
+
+			this->socket_handle = other.socket_handle;
+			this->prepared_handle = other.prepared_handle;
+			this->prepared_family = other.prepared_family;
+			this->blocking = other.blocking;
+			this->zero_copy = other.zero_copy;
+			this->profile = std::move( other.profile );
+			this->policy = other.policy;
+			this->metrics = other.metrics;
+
+			other.socket_handle = INVALID_SOCKET;
+			other.prepared_handle = INVALID_SOCKET;
+			other.blocking = true;
+			other.zero_copy = zero_copy_state::unknown;
+		}
+
+		return *this;
+	}
+
+	bool
+	socket::is_connected() const noexcept
+	{
+		return ( this->socket_handle != INVALID_SOCKET );
+	}
+
+	bool
+	socket::is_blocking() const noexcept
+	{
+		return this->blocking;
+	}
+
+	SOCKET
+	socket::get_handle() const noexcept
+	{
+		return this->socket_handle;
+	}
+
+	// Resolves the host and connects the socket to it through the specified
+	// communication port
+	bool
+	socket::connect_client_socket(
+		std::string const & host_address,
+		std::uint16_t port ) noexcept
+	{
+		const auto endpoints = resolver::lookup( host_address, ( port == 0 ) ? DEFAULT_PORT : port );
+
+		return this->connect_client_socket( endpoints );
+	}
+
+	// Connects the socket to the first reachable of the resolved endpoints
+	bool
+	socket::connect_client_socket( std::vector< endpoint > const & endpoints ) noexcept
+	{
+		if ( endpoints.empty() )
+		{
+			return false;
+		}
+
+		return this->connect_with_retries( endpoints.data(), endpoints.size() );
+	}
+
+	// Connects the socket to an already resolved peer
+	bool
+	socket::connect_client_socket( endpoint const & peer ) noexcept
+	{
+		if ( !peer.is_valid() )
+		{
+			return false;
+		}
+
+		return this->connect_with_retries( &peer, 1 );
+	}
+
+	// Starts connecting to the peer without waiting, for sockets driven by
+	// a reactor. The socket is left in non-blocking mode; once it becomes
+	// writable, finish_connect_client_socket tells whether it connected.
+	bool
+	socket::start_connect_client_socket( endpoint const & peer ) noexcept
+	{
+		this->close();
+
+		if ( !peer.is_valid() )
+		{
+			return false;
+		}
+
+		bool connected = false;
+		const auto handle = this->start_connect( peer, connected );
+
+		if ( handle == INVALID_SOCKET )
+		{
+			return false;
+		}
+
+		this->socket_handle = handle;
+		this->blocking = false;
+		this->metrics = connect_metrics {};
+		this->metrics.attempts = 1;
+
+		return true;
+	}
+
+	// Completes a connection started by start_connect_client_socket, once
+	// the socket is writable. Returns false if the connection failed; the
+	// socket is left for the caller to close.
+	bool
+	socket::finish_connect_client_socket() noexcept
+	{
+		int error = 0;
+		SOCKLEN error_length = sizeof( error );
+
+		if ( !this->is_connected() ||
+			 ( ::getsockopt( this->socket_handle, SOL_SOCKET, SO_ERROR, reinterpret_cast< char* >( &error ), &error_length ) != 0 ) ||
+			 ( error != 0 ) )
+		{
+			std::cerr << "Cannot connect client TCP socket.";
+			return false;
+		}
+
+		this->apply_profile( this->socket_handle, true, false );
+		this->metrics.connected = true;
+
+		return true;
+	}
+
+	// Returns the address of the connected peer
+	endpoint
+	socket::get_peer_endpoint() const noexcept
+	{
+		endpoint peer;
+		SOCKLEN address_length = sizeof( peer.address );
+
+		if ( ::getpeername( this->socket_handle, reinterpret_cast< SOCKADDR* >( &peer.address ), &address_length ) == 0 )
+		{
+			peer.address_length = static_cast< int >( address_length );
+		}
+
+		return peer;
+	}
+
+	// Connects to the endpoints, retrying failed attempts after a jittered,
+	// exponentially growing delay. Every attempt is bounded by the
+	// per-attempt timeout and all attempts by the overall one.
+	bool
+	socket::connect_with_retries(
+		endpoint const * endpoints,
+		std::size_t count ) noexcept
+	{
+		using clock = std::chrono::steady_clock;
+
+		// Source of the backoff jitter
+		static thread_local std::minstd_rand jitter_engine( static_cast< std::minstd_rand::result_type >( clock::now().time_since_epoch().count() ) );
+
+		const auto start = clock::now();
+		const auto deadline = start + this->policy.overall_timeout;
+
+		auto backoff = this->policy.initial_backoff;
+
+		this->metrics = connect_metrics {};
+
+		while ( true )
+		{
+			const auto remaining = std::chrono::duration_cast< std::chrono::milliseconds >( deadline - clock::now() );
+
+			++this->metrics.attempts;
+
+			const bool connected = this->connect_attempt( endpoints, count, std::min( this->policy.attempt_timeout, remaining ) );
+
+			this->metrics.elapsed = std::chrono::duration_cast< std::chrono::microseconds >( clock::now() - start );
+
+			if ( connected )
+			{
+				this->metrics.connected = true;
+
+				return true;
+			}
+
+			if ( this->metrics.attempts >= this->policy.max_attempts )
+			{
+				break;
+			}
+
+			// Sleep between half and all of the backoff, within the deadline
+			std::uniform_int_distribution< std::chrono::milliseconds::rep > jitter( backoff.count() / 2, backoff.count() );
+			const auto delay = std::chrono::milliseconds( jitter( jitter_engine ) );
+
+			if ( clock::now() + delay >= deadline )
+			{
+				break;
+			}
+
+			std::this_thread::sleep_for( delay );
+
+			backoff = std::min( backoff * 2, this->policy.max_backoff );
+		}
+
+		std::cerr << "Cannot connect client TCP socket after " << this->metrics.attempts << " attempt(s) in "
+				  << std::chrono::duration_cast< std::chrono::milliseconds >( this->metrics.elapsed ).count() << " ms.";
+
+		return false;
+	}
+
+	// Races connections to the endpoints as in Happy Eyeballs (RFC 8305):
+	// a new attempt starts every 250 ms, or as soon as the previous one
+	// fails, and the first socket to connect wins while the others are
+	// closed. The socket is left connected in blocking mode, or closed.
+	bool
+	socket::connect_attempt(
+		endpoint const * endpoints,
+		std::size_t count,
+		std::chrono::milliseconds timeout ) noexcept
+	{
+		using clock = std::chrono::steady_clock;
+
+		// Delay before racing the next endpoint (Connection Attempt Delay)
+		static constexpr std::chrono::milliseconds attempt_delay { 250 };
+		// Maximum number of concurrent attempts
+		static constexpr std::size_t max_pending = 8;
+
+		this->close();
+
+		const auto deadline = clock::now() + timeout;
+		auto next_start = clock::now();
+
+		std::array< pollfd, max_pending > pending;
+		std::size_t pending_count = 0;
+		std::size_t next = 0;
+
+		auto winner = INVALID_SOCKET;
+
+		while ( winner == INVALID_SOCKET )
+		{
+			const auto now = clock::now();
+
+			if ( now >= deadline )
+			{
+				break;
+			}
+
+			if ( ( next < count ) && ( now >= next_start ) && ( pending_count < max_pending ) )
+			{
+				bool connected = false;
+				const auto handle = this->start_connect( endpoints[next++], connected );
+
+				if ( connected )
+				{
+					winner = handle;
+					break;
+				}
+
+				if ( handle != INVALID_SOCKET )
+				{
+					pending[pending_count] = pollfd {};
+					pending[pending_count].fd = handle;
+					pending[pending_count].events = POLLOUT;
+					++pending_count;
+
+					next_start = now + attempt_delay;
+				}
+
+				// A failed start lets the next endpoint start right away
+				continue;
+			}
+
+			if ( ( pending_count == 0 ) && ( next >= count ) )
+			{
+				break;
+			}
+
+			auto wake_up = deadline;
+
+			if ( ( next < count ) && ( pending_count < max_pending ) )
+			{
+				wake_up = std::min( wake_up, next_start );
+			}
+
+			const auto wait = std::chrono::duration_cast< std::chrono::milliseconds >( wake_up - now ).count() + 1;
+
+			if ( poll_handles( pending.data(), pending_count, static_cast< int >( wait ) ) == SOCKET_ERROR )
+			{
+				break;
+			}
+
+			for ( std::size_t idx = 0; idx < pending_count; )
+			{
+				if ( pending[idx].revents == 0 )
+				{
+					++idx;
+					continue;
+				}
+
+				int error = 0;
+				SOCKLEN error_length = sizeof( error );
+
+				if ( ( winner == INVALID_SOCKET ) &&
+					 ( ::getsockopt( pending[idx].fd, SOL_SOCKET, SO_ERROR, reinterpret_cast< char* >( &error ), &error_length ) == 0 ) &&
+					 ( error == 0 ) &&
+					 ( ( pending[idx].revents & ( POLLERR | POLLHUP ) ) == 0 ) )
+				{
+					winner = pending[idx].fd;
+				}
+				else
+				{
+					close_handle( pending[idx].fd );
+
+					// A failed attempt lets the next endpoint start right away
+					next_start = clock::now();
+				}
+
+				pending[idx] = pending[--pending_count];
+			}
+		}
+
+		for ( std::size_t idx = 0; idx < pending_count; ++idx )
+		{
+			close_handle( pending[idx].fd );
+		}
+
+		if ( winner == INVALID_SOCKET )
+		{
+			return false;
+		}
+
+		this->socket_handle = winner;
+
+		if ( !this->set_blocking( true ) )
+		{
+			this->close();
+			return false;
+		}
+
+		this->apply_profile( this->socket_handle, true, false );
+
+		return true;
+	}
+
+	// Starts connecting a non-blocking TCP socket to the endpoint, using the
+	// prepared socket when it has the right address family.
+	// Returns the socket, with connected set if the connection completed
+	// immediately, or INVALID_SOCKET if the attempt failed right away.
+	SOCKET
+	socket::start_connect(
+		endpoint const & peer,
+		bool& connected ) noexcept
+	{
+		connected = false;
+
+		auto handle = INVALID_SOCKET;
+
+		if ( ( this->prepared_handle != INVALID_SOCKET ) && ( this->prepared_family == peer.get_family() ) )
+		{
+			handle = this->prepared_handle;
+			this->prepared_handle = INVALID_SOCKET;
+		}
+		else
+		{
+			handle = this->open_handle( peer.get_family() );
+		}
+
+		if ( handle == INVALID_SOCKET )
+		{
+			return INVALID_SOCKET;
+		}
+
+		if ( ::connect( handle, reinterpret_cast< const SOCKADDR* >( &peer.address ), peer.address_length ) != SOCKET_ERROR )
+		{
+			connected = true;
+		}
+		else if ( !is_connect_pending() )
+		{
+			close_handle( handle );
+			return INVALID_SOCKET;
+		}
+
+		return handle;
+	}
+
+	// Opens a non-blocking TCP socket tuned with the socket profile
+	SOCKET
+	socket::open_handle( int family ) const noexcept
+	{
+		// Open a TCP socket (an Internet stream socket)
+		auto handle = ::socket( family, SOCK_STREAM, 0 );
+
+		if ( ( handle != INVALID_SOCKET ) && !this->apply_profile( handle, false, true ) )
+		{
+			// Clamped buffers stay locked at their size; a new socket
+			// keeps the automatic tuning instead
+			close_handle( handle );
+
+			handle = ::socket( family, SOCK_STREAM, 0 );
+
+			if ( handle != INVALID_SOCKET )
+			{
+				this->apply_profile( handle, false, false );
+			}
+		}
+
+		if ( handle == INVALID_SOCKET )
+		{
+			std::cerr << "Cannot open a client TCP socket.";
+			return INVALID_SOCKET;
+		}
+
+		if ( !set_handle_blocking( handle, false ) )
+		{
+			close_handle( handle );
+			return INVALID_SOCKET;
+		}
+
+		return handle;
+	}
+
+	// Creates and tunes the underlying TCP socket ahead of time, so that
+	// the next connection to an address of that family skips this work
+	bool
+	socket::prepare( int family ) noexcept
+	{
+		this->release_prepared();
+
+		this->prepared_handle = this->open_handle( family );
+		this->prepared_family = family;
+
+		return this->is_prepared();
+	}
+
+	bool
+	socket::is_prepared() const noexcept
+	{
+		return ( this->prepared_handle != INVALID_SOCKET );
+	}
+
+	int
+	socket::get_prepared_family() const noexcept
+	{
+		return this->prepared_family;
+	}
+
+	void
+	socket::release_prepared() noexcept
+	{
+		if ( this->is_prepared() )
+		{
+			close_handle( this->prepared_handle );
+		}
+
+		this->prepared_handle = INVALID_SOCKET;
+	}
+
+	// Sets the timeouts and retries of subsequent connections
+	void
+	socket::set_connect_policy( connect_policy const & policy ) noexcept
+	{
+		this->policy = policy;
+	}
+
+	// Returns the attempts and time spent by the last connection,
+	// i.e. its time-to-connect or its time-to-failure
+	connect_metrics
+	socket::get_connect_metrics() const noexcept
+	{
+		return this->metrics;
+	}
+
+	// Sets the TCP options applied to the socket when it connects;
+	// a socket prepared with the previous options is released
+	void
+	socket::set_profile( socket_profile const & profile )
+	{
+		this->release_prepared();
+		this->profile = profile;
+	}
+
+	// Changes the bytes buffered before a receive completes, on the
+	// connected socket only
+	bool
+	socket::set_receive_low_water_mark( int bytes ) noexcept
+	{
+		return this->is_connected() &&
+			( ::setsockopt( this->socket_handle, SOL_SOCKET, SO_RCVLOWAT, reinterpret_cast< char const * >( &bytes ), sizeof( bytes ) ) == 0 );
+	}
+
+	// Switches the socket between blocking and non-blocking mode.
+	// In non-blocking mode, send_message and receive_message return
+	// WOULD_BLOCK instead of waiting for the partner socket.
+	bool
+	socket::set_blocking( bool blocking ) noexcept
+	{
+		if ( !this->is_connected() || !set_handle_blocking( this->socket_handle, blocking ) )
+		{
+			return false;
+		}
+
+		this->blocking = blocking;
+
+		return true;
+	}
+
+	void
+	socket::close() noexcept
+	{
+		if ( this->is_connected() )
+		{
+			close_handle( this->socket_handle );
+		}
+
+		this->socket_handle = INVALID_SOCKET;
+		this->blocking = true;
+		this->zero_copy = zero_copy_state::unknown;
+	}
+
+	// Shuts down both directions of the connection, waking up any call
+	// blocked on the socket. The handle stays open until close().
+	// Only makes a system call, so it may be called from a signal handler.
+	void
+	socket::shutdown() const noexcept
+	{
+		if ( this->is_connected() )
+		{
+		#ifdef __linux__
+			::shutdown( this->socket_handle, SHUT_RDWR );
+		#elif _WIN32
+			::shutdown( this->socket_handle, SD_BOTH );
+		#endif
+		}
+	}
+
+	// Sends a message to partner socket
+	int
+	socket::send_message(
+		void* buffer,
+		std::size_t buffer_size ) const noexcept
+	{
+		auto bytes_sent = 0;
+
+		if ( buffer != nullptr )
+		{
+			bytes_sent = ::send( this->socket_handle, static_cast< char* >( buffer ), buffer_size, 0 );
+
+			if ( ( bytes_sent == SOCKET_ERROR ) && this->would_block() )
+			{
+				bytes_sent = WOULD_BLOCK;
+			}
+			else if ( bytes_sent == SOCKET_ERROR )
+			{
+				std::cerr << "Failed to send data.";
+				bytes_sent = 0;
+			}
+		}
+
+		return bytes_sent;
+	}
+
+	// Sends a message to partner socket as TCP urgent data; the urgent
+	// mark falls on its last byte
+	int
+	socket::send_urgent_message(
+		void const * buffer,
+		std::size_t buffer_size ) const noexcept
+	{
+		auto bytes_sent = 0;
+
+		if ( buffer != nullptr )
+		{
+		#ifdef __linux__
+			bytes_sent = static_cast< int >( ::send( this->socket_handle, buffer, buffer_size, MSG_OOB | MSG_NOSIGNAL ) );
+		#elif _WIN32
+			bytes_sent = ::send( this->socket_handle, static_cast< char const * >( buffer ), static_cast< int >( buffer_size ), MSG_OOB );
+		#endif
+
+			if ( bytes_sent == SOCKET_ERROR )
+			{
+				std::cerr << "Failed to send urgent data.";
+				bytes_sent = 0;
+			}
+		}
 
-namespace networking
-{
-	socket::~socket() noexcept
-	{
-		this->close();
+		return bytes_sent;
 	}
 
-	bool
-	socket::is_connected() const noexcept
+	// Sends the buffers to partner socket as a single message (gather)
+	int
+	socket::send_message(
+		IOVEC const * buffers,
+		std::size_t buffer_count ) const noexcept
 	{
-		return ( this->socket_handle != INVALID_SOCKET );
-	}
+		auto bytes_sent = 0;
 
-	// Connects the socket to the given host through specified communication port
-	bool
-	socket::connect_client_socket(
-		std::string const & host_address,
-		std::uint16_t port ) noexcept
-	{
-		if ( port == 0 )
+		if ( buffers != nullptr )
 		{
-			static constexpr auto default_ftp_port = 21;
+		#ifdef __linux__
+			msghdr message_header = {};
 
-			port = default_ftp_port;
+			message_header.msg_iov = const_cast< IOVEC* >( buffers );
+			message_header.msg_iovlen = buffer_count;
+
+			bytes_sent = static_cast< int >( ::sendmsg( this->socket_handle, &message_header, MSG_NOSIGNAL ) );
+		#elif _WIN32
+			DWORD size_sent = 0;
+
+			bytes_sent = ( ::WSASend( this->socket_handle, const_cast< IOVEC* >( buffers ), static_cast< DWORD >( buffer_count ), &size_sent, 0, nullptr, nullptr ) == 0 ) ?
+				static_cast< int >( size_sent ) :
+				SOCKET_ERROR;
+		#endif
+
+			if ( ( bytes_sent == SOCKET_ERROR ) && this->would_block() )
+			{
+				bytes_sent = WOULD_BLOCK;
+			}
+			else if ( bytes_sent == SOCKET_ERROR )
+			{
+				std::cerr << "Failed to send data.";
+				bytes_sent = 0;
+			}
 		}
 
-		// Fill in the data needed for connecting to the server.
-		SOCKADDR_IN sock_addr = {};
+		return bytes_sent;
+	}
 
-		sock_addr.sin_family = AF_INET;
-		sock_addr.sin_addr.s_addr = ::inet_addr( host_address.c_str() );
-		sock_addr.sin_port = ::htons( port );
+	// Sends all the buffers to partner socket, resuming after partial sends.
+	// The buffers are advanced past the bytes sent.
+	int
+	socket::send_message_all(
+		IOVEC* buffers,
+		std::size_t buffer_count ) const noexcept
+	{
+		auto bytes_sent = 0;
 
-		if ( sock_addr.sin_addr.s_addr == INADDR_NONE )
+		while ( buffer_count > 0 )
 		{
-			LPHOSTENT host = ::gethostbyname( host_address.c_str() );
+			const auto size_sent = this->send_message( buffers, buffer_count );
 
-			if ( host == nullptr )
+			if ( size_sent <= 0 )
 			{
-				std::cerr << "Cannot find hostname.";
-				return false;
+				break;
 			}
 
-			const auto internet_address = reinterpret_cast< LPIN_ADDR >( *host->h_addr_list );
-			sock_addr.sin_addr.s_addr = ::inet_addr( ::inet_ntoa( *internet_address ) );
-		}
+			bytes_sent += size_sent;
 
-		// Open a TCP socket (an Internet stream socket)
-		this->socket_handle = ::socket( AF_INET, SOCK_STREAM, 0 );
+			// Skip the buffers sent entirely and advance into the last one
+			for ( auto remaining = static_cast< std::size_t >( size_sent ); ( buffer_count > 0 ) && ( remaining > 0 ); )
+			{
+				const auto consumed = std::min( remaining, buffer_length( *buffers ) );
 
-		if ( this->socket_handle == INVALID_SOCKET )
-		{
-			std::cerr << "Cannot open a client TCP socket.";
-			return false;
-		}
+				advance_buffer( *buffers, consumed );
+				remaining -= consumed;
 
-		// Connect to the server
-		auto pass = 0;
-		while ( ::connect( this->socket_handle, reinterpret_cast< const SOCKADDR* >( &sock_addr ), sizeof( sock_addr ) ) == SOCKET_ERROR )
-		{
-			// Max number of connection retries
-			static constexpr auto connection_retries = 10;
+				if ( buffer_length( *buffers ) == 0 )
+				{
+					++buffers;
+					--buffer_count;
+				}
+			}
 
-			if ( ++pass >= connection_retries )
+			// Empty buffers left at the front need no send
+			while ( ( buffer_count > 0 ) && ( buffer_length( *buffers ) == 0 ) )
 			{
-				this->close();
-
-				std::cerr << "Cannot connect client TCP socket.";
-				return false;
+				++buffers;
+				--buffer_count;
 			}
 		}
 
-		return true;
-	}
-
-	void
-	socket::close() noexcept
-	{
-	#ifdef __linux__ 
-		::close( this->socket_handle );
-	#elif _WIN32
-		::closesocket( this->socket_handle );
-	#endif
-
-		this->socket_handle = INVALID_SOCKET;
+		return bytes_sent;
 	}
 
-	// Sends a message to partner socket
+	// Receives a message from partner socket into the buffers (scatter)
 	int
-	socket::send_message(
-		void* buffer,
-		std::size_t buffer_size ) const noexcept
+	socket::receive_message(
+		IOVEC const * buffers,
+		std::size_t buffer_count ) const noexcept
 	{
-		auto bytes_sent = 0;
+		auto bytes_received = 0;
 
-		if ( buffer != nullptr )
+		if ( buffers != nullptr )
 		{
-			bytes_sent = ::send( this->socket_handle, static_cast< char* >( buffer ), buffer_size, 0 );
+		#ifdef __linux__
+			msghdr message_header = {};
 
-			if ( bytes_sent == SOCKET_ERROR )
+			message_header.msg_iov = const_cast< IOVEC* >( buffers );
+			message_header.msg_iovlen = buffer_count;
+
+			bytes_received = static_cast< int >( ::recvmsg( this->socket_handle, &message_header, 0 ) );
+		#elif _WIN32
+			DWORD size_received = 0;
+			DWORD flags = 0;
+
+			bytes_received = ( ::WSARecv( this->socket_handle, const_cast< IOVEC* >( buffers ), static_cast< DWORD >( buffer_count ), &size_received, &flags, nullptr, nullptr ) == 0 ) ?
+				static_cast< int >( size_received ) :
+				SOCKET_ERROR;
+		#endif
+
+			if ( ( bytes_received == SOCKET_ERROR ) && this->would_block() )
 			{
-				std::cerr << "Failed to send data.";
-				bytes_sent = 0;
+				bytes_received = WOULD_BLOCK;
+			}
+			else if ( bytes_received == SOCKET_ERROR )
+			{
+				std::cerr << "Failed to receive data.";
+				bytes_received = FAILED;
 			}
 		}
 
-		return bytes_sent;
+		return bytes_received;
 	}
 
 	// Receives a message from partner socket 
@@ -147,10 +948,14 @@ namespace networking
 		{
 			bytes_received = ::recv( this->socket_handle, static_cast< char* >( buffer ), buffer_size, 0 );
 
-			if ( bytes_received == SOCKET_ERROR )
+			if ( ( bytes_received == SOCKET_ERROR ) && this->would_block() )
+			{
+				bytes_received = WOULD_BLOCK;
+			}
+			else if ( bytes_received == SOCKET_ERROR )
 			{
 				std::cerr << "Failed to receive data.";
-				bytes_received = 0;
+				bytes_received = FAILED;
 			}
 		}
 
@@ -176,6 +981,10 @@ namespace networking
 			{
 				bytes_received += size_received;
 			}
+			else if ( size_received == FAILED )
+			{
+				return FAILED;
+			}
 			else
 			{
 				break;
@@ -184,4 +993,415 @@ namespace networking
 
 		return bytes_received;
 	}
-}
+
+	// Sends up to size bytes of the file, starting at its current position,
+	// without copying them through user space. The file position is advanced
+	// past the bytes sent. Returns the number of bytes sent, or -1 if the file
+	// cannot be sent this way before any byte went out.
+	std::int64_t
+	socket::send_file(
+		int file_handle,
+		std::uint64_t size ) const noexcept
+	{
+	#ifdef __linux__
+		std::uint64_t bytes_sent = 0;
+
+		while ( bytes_sent < size )
+		{
+			// sendfile moves at most about 2 GB per call
+			static constexpr std::uint64_t max_chunk = 0x7ffff000;
+
+			const auto chunk = std::min( size - bytes_sent, max_chunk );
+			const auto size_sent = ::sendfile( this->socket_handle, file_handle, nullptr, static_cast< std::size_t >( chunk ) );
+
+			if ( size_sent == SOCKET_ERROR )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+
+				if ( this->would_block() )
+				{
+					break;
+				}
+
+				if ( bytes_sent == 0 )
+				{
+					return -1;
+				}
+
+				std::cerr << "Failed to send file.";
+				break;
+			}
+
+			if ( size_sent == 0 )
+			{
+				// The file is shorter than expected
+				break;
+			}
+
+			bytes_sent += static_cast< std::uint64_t >( size_sent );
+		}
+
+		return static_cast< std::int64_t >( bytes_sent );
+	#else
+		static_cast< void >( file_handle );
+		static_cast< void >( size );
+
+		return -1;
+	#endif
+	}
+
+	// Receives until the partner socket closes and moves the data into the
+	// file at its current position through a kernel pipe, so that it never
+	// passes through user space. The file must support splice (e.g. a regular
+	// file not opened for appending). Returns the number of bytes received,
+	// or -1 on failure.
+	std::int64_t
+	socket::receive_to_file( int file_handle ) const noexcept
+	{
+	#ifdef __linux__
+		// Requested pipe capacity; each splice moves at most this much
+		static constexpr auto pipe_size = 1024 * 1024;
+
+		int pipe_handles[2];
+
+		if ( ::pipe2( pipe_handles, O_CLOEXEC ) == SOCKET_ERROR )
+		{
+			std::cerr << "Cannot create a pipe.";
+			return -1;
+		}
+
+		// The default capacity is kept if the system limit is lower
+		::fcntl( pipe_handles[1], F_SETPIPE_SZ, pipe_size );
+
+		std::int64_t bytes_received = 0;
+		bool failed = false;
+
+		while ( !failed )
+		{
+			const auto size_received = ::splice( this->socket_handle, nullptr, pipe_handles[1], nullptr, pipe_size, SPLICE_F_MOVE | SPLICE_F_MORE );
+
+			if ( size_received == SOCKET_ERROR )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+
+				std::cerr << "Failed to receive data.";
+				failed = true;
+				break;
+			}
+
+			if ( size_received == 0 )
+			{
+				break;
+			}
+
+			// Drain the pipe into the file
+			for ( auto pending = size_received; pending > 0; )
+			{
+				const auto size_written = ::splice( pipe_handles[0], nullptr, file_handle, nullptr, static_cast< std::size_t >( pending ), SPLICE_F_MOVE | SPLICE_F_MORE );
+
+				if ( size_written <= 0 )
+				{
+					if ( ( size_written == SOCKET_ERROR ) && ( errno == EINTR ) )
+					{
+						continue;
+					}
+
+					std::cerr << "Failed to write to the local file.";
+					failed = true;
+					break;
+				}
+
+				pending -= size_written;
+			}
+
+			bytes_received += size_received;
+		}
+
+		::close( pipe_handles[0] );
+		::close( pipe_handles[1] );
+
+		return failed ? -1 : bytes_received;
+	#else
+		static_cast< void >( file_handle );
+
+		return -1;
+	#endif
+	}
+
+	// Sends the whole buffer with MSG_ZEROCOPY, letting the kernel transmit
+	// straight from the caller's pages. Returns once the kernel has released
+	// the buffer, so that the caller may reuse it, with the number of bytes
+	// sent or -1 on failure. Small sends are copied as usual, and zero-copy is
+	// switched off for the socket once the kernel reports it had to copy
+	// anyway (e.g. on loopback), since the notifications are then pure overhead.
+	std::int64_t
+	socket::send_message_zero_copy(
+		void const * buffer,
+		std::size_t buffer_size ) noexcept
+	{
+		if ( buffer == nullptr )
+		{
+			return -1;
+		}
+
+		auto const * data = static_cast< char const * >( buffer );
+		std::size_t bytes_sent = 0;
+
+		if ( ( buffer_size < ZERO_COPY_THRESHOLD ) || !this->enable_zero_copy() )
+		{
+			while ( bytes_sent < buffer_size )
+			{
+				const auto size_sent = this->send_message( const_cast< char* >( data + bytes_sent ), buffer_size - bytes_sent );
+
+				if ( size_sent <= 0 )
+				{
+					return -1;
+				}
+
+				bytes_sent += static_cast< std::size_t >( size_sent );
+			}
+
+			return static_cast< std::int64_t >( bytes_sent );
+		}
+
+	#ifdef __linux__
+		// Every successful zero-copy send is acknowledged by one notification
+		std::uint32_t sends = 0;
+		std::uint32_t completed = 0;
+		bool copied = false;
+		bool failed = false;
+
+		while ( bytes_sent < buffer_size )
+		{
+			const auto size_sent = ::send( this->socket_handle, data + bytes_sent, buffer_size - bytes_sent, MSG_ZEROCOPY | MSG_NOSIGNAL );
+
+			if ( size_sent == SOCKET_ERROR )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+
+				// Too many pinned pages; wait for the kernel to release some
+				if ( ( errno == ENOBUFS ) && ( completed < sends ) &&
+					 this->wait_zero_copy_completions( completed, copied ) )
+				{
+					continue;
+				}
+
+				std::cerr << "Failed to send data.";
+				failed = true;
+				break;
+			}
+
+			bytes_sent += static_cast< std::size_t >( size_sent );
+			++sends;
+		}
+
+		while ( completed < sends )
+		{
+			if ( !this->wait_zero_copy_completions( completed, copied ) )
+			{
+				failed = true;
+				break;
+			}
+		}
+
+		if ( copied )
+		{
+			this->zero_copy = zero_copy_state::disabled;
+		}
+
+		return failed ? -1 : static_cast< std::int64_t >( bytes_sent );
+	#else
+		return -1;
+	#endif
+	}
+
+	// Enables SO_ZEROCOPY on first use; returns false if unsupported
+	bool
+	socket::enable_zero_copy() noexcept
+	{
+	#ifdef __linux__
+		if ( this->zero_copy == zero_copy_state::unknown )
+		{
+			const int enable = 1;
+
+			this->zero_copy = ( ::setsockopt( this->socket_handle, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof( enable ) ) == 0 ) ?
+				zero_copy_state::enabled :
+				zero_copy_state::disabled;
+		}
+
+		return this->zero_copy == zero_copy_state::enabled;
+	#else
+		return false;
+	#endif
+	}
+
+	// Waits for zero-copy completion notifications on the error queue and
+	// adds the number of acknowledged sends to completed. Sets copied if the
+	// kernel reports having copied the data regardless.
+	bool
+	socket::wait_zero_copy_completions(
+		std::uint32_t& completed,
+		bool& copied ) const noexcept
+	{
+	#ifdef __linux__
+		pollfd poll_handle = {};
+
+		// Error queue readiness is always reported as POLLERR
+		poll_handle.fd = this->socket_handle;
+
+		if ( ( ::poll( &poll_handle, 1, -1 ) == SOCKET_ERROR ) && ( errno != EINTR ) )
+		{
+			return false;
+		}
+
+		while ( true )
+		{
+			char control[CMSG_SPACE( sizeof( sock_extended_err ) + sizeof( sockaddr_storage ) )];
+			msghdr message_header = {};
+
+			message_header.msg_control = control;
+			message_header.msg_controllen = sizeof( control );
+
+			if ( ::recvmsg( this->socket_handle, &message_header, MSG_ERRQUEUE | MSG_DONTWAIT ) == SOCKET_ERROR )
+			{
+				return ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) || ( errno == EINTR );
+			}
+
+			for ( auto* control_message = CMSG_FIRSTHDR( &message_header ); control_message != nullptr; control_message = CMSG_NXTHDR( &message_header, control_message ) )
+			{
+				const bool is_error =
+					( ( control_message->cmsg_level == SOL_IP ) && ( control_message->cmsg_type == IP_RECVERR ) ) ||
+					( ( control_message->cmsg_level == SOL_IPV6 ) && ( control_message->cmsg_type == IPV6_RECVERR ) );
+
+				if ( !is_error )
+				{
+					continue;
+				}
+
+				sock_extended_err error = {};
+				std::copy(
+					reinterpret_cast< unsigned char const * >( CMSG_DATA( control_message ) ),
+					reinterpret_cast< unsigned char const * >( CMSG_DATA( control_message ) ) + sizeof( error ),
+					reinterpret_cast< unsigned char* >( &error ) );
+
+				if ( ( error.ee_errno != 0 ) || ( error.ee_origin != SO_EE_ORIGIN_ZEROCOPY ) )
+				{
+					continue;
+				}
+
+				// Notifications acknowledge a range of sends [ee_info, ee_data]
+				completed += error.ee_data - error.ee_info + 1;
+
+				if ( error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED )
+				{
+					copied = true;
+				}
+			}
+		}
+	#else
+		static_cast< void >( completed );
+		static_cast< void >( copied );
+
+		return false;
+	#endif
+	}
+
+	// Applies the socket profile. Buffer sizes and most options must be set
+	// before connecting so that the window scale is negotiated accordingly;
+	// quick acknowledgements are not sticky and are set once connected.
+	// Options the system refuses (e.g. an unavailable congestion control)
+	// are left at their default.
+	// Returns false if a buffer size was clamped; buffer sizes are skipped
+	// when with_buffers is false.
+	bool
+	socket::apply_profile(
+		SOCKET handle,
+		bool connected,
+		bool with_buffers ) const noexcept
+	{
+		auto set_option = [handle]( int level, int name, int value )
+		{
+			::setsockopt( handle, level, name, reinterpret_cast< char const * >( &value ), sizeof( value ) );
+		};
+
+		if ( connected )
+		{
+		#ifdef __linux__
+			if ( this->profile.quick_ack )
+			{
+				set_option( IPPROTO_TCP, TCP_QUICKACK, 1 );
+			}
+		#endif
+
+			return true;
+		}
+
+		bool buffers_set = true;
+
+		if ( with_buffers && ( this->profile.receive_buffer_size > 0 ) )
+		{
+			buffers_set = set_buffer_size( handle, SO_RCVBUF, this->profile.receive_buffer_size );
+		}
+
+		if ( with_buffers && ( this->profile.send_buffer_size > 0 ) )
+		{
+			buffers_set = set_buffer_size( handle, SO_SNDBUF, this->profile.send_buffer_size ) && buffers_set;
+		}
+
+		if ( this->profile.receive_low_water_mark > 0 )
+		{
+			set_option( SOL_SOCKET, SO_RCVLOWAT, this->profile.receive_low_water_mark );
+		}
+
+		if ( this->profile.no_delay )
+		{
+			set_option( IPPROTO_TCP, TCP_NODELAY, 1 );
+		}
+
+	#ifdef __linux__
+		if ( this->profile.cork )
+		{
+			set_option( IPPROTO_TCP, TCP_CORK, 1 );
+		}
+
+		if ( this->profile.not_sent_low_water_mark > 0 )
+		{
+			set_option( IPPROTO_TCP, TCP_NOTSENT_LOWAT, this->profile.not_sent_low_water_mark );
+		}
+
+		if ( !this->profile.congestion_control.empty() &&
+			 ( ::setsockopt( handle, IPPROTO_TCP, TCP_CONGESTION, this->profile.congestion_control.c_str(), this->profile.congestion_control.size() ) == SOCKET_ERROR ) )
+		{
+			std::cerr << "Congestion control " << this->profile.congestion_control << " is unavailable.";
+		}
+	#endif
+
+		return buffers_set;
+	}
+
+	// Checks whether the last failed operation only failed because
+	// the non-blocking socket was not ready
+	bool
+	socket::would_block() const noexcept
+	{
+		if ( this->blocking )
+		{
+			return false;
+		}
+
+	#ifdef __linux__
+		return ( errno == EAGAIN ) || ( errno == EWOULDBLOCK );
+	#elif _WIN32
+		return ::WSAGetLastError() == WSAEWOULDBLOCK;
+	#endif
+	}
+}
\ No newline at end of file
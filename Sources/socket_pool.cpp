@@ -0,0 +1,98 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "socket_pool.hpp"
+
+#include <algorithm>
+
+namespace networking
+{
+	socket_pool::socket_pool(
+		socket_profile const & profile,
+		std::size_t capacity ) :
+		profile( profile ),
+		capacity( capacity )
+	{
+	}
+
+	// Returns the number of prepared sockets
+	std::size_t
+	socket_pool::size() const noexcept
+	{
+		return this->sockets.size();
+	}
+
+	// Hands out a socket prepared for the address family, or a socket
+	// carrying the pool's options if none is prepared
+	socket
+	socket_pool::acquire( int family )
+	{
+		const auto found = std::find_if( std::begin( this->sockets ), std::end( this->sockets ), [family]( socket const & pooled )
+		{
+			return pooled.is_prepared() && ( pooled.get_prepared_family() == family );
+		} );
+
+		if ( found != std::end( this->sockets ) )
+		{
+			socket acquired( std::move( *found ) );
+
+			this->sockets.erase( found );
+
+			return acquired;
+		}
+
+		socket created;
+
+		created.set_profile( this->profile );
+		created.set_connect_policy( this->policy );
+
+		return created;
+	}
+
+	// Prepares sockets for the address family up to the pool capacity
+	void
+	socket_pool::fill( int family )
+	{
+		while ( this->sockets.size() < this->capacity )
+		{
+			socket prepared;
+
+			prepared.set_profile( this->profile );
+			prepared.set_connect_policy( this->policy );
+
+			if ( !prepared.prepare( family ) )
+			{
+				break;
+			}
+
+			this->sockets.push_back( std::move( prepared ) );
+		}
+	}
+
+	void
+	socket_pool::clear() noexcept
+	{
+		this->sockets.clear();
+	}
+
+	// Sets the options of subsequent sockets; prepared ones are released
+	void
+	socket_pool::set_profile( socket_profile const & profile )
+	{
+		this->clear();
+		this->profile = profile;
+	}
+
+	void
+	socket_pool::set_connect_policy( connect_policy const & policy ) noexcept
+	{
+		this->policy = policy;
+
+		for ( auto& pooled : this->sockets )
+		{
+			pooled.set_connect_policy( policy );
+		}
+	}
+}
@@ -0,0 +1,230 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "transfer_checkpoint.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+#ifdef __linux__
+	#include <unistd.h>
+#endif
+
+namespace networking
+{
+	// Extends an Adler-32 checksum (RFC 1950) with more bytes
+	static std::uint32_t
+	update_adler32(
+		std::uint32_t checksum,
+		unsigned char const * data,
+		std::size_t size ) noexcept
+	{
+		static constexpr std::uint32_t MODULO = 65521;
+		// Largest run of bytes before the sums may overflow
+		static constexpr std::size_t RUN_LENGTH = 5552;
+
+		std::uint32_t low = checksum & 0xffff;
+		std::uint32_t high = checksum >> 16;
+
+		while ( size > 0 )
+		{
+			const auto run = std::min( size, RUN_LENGTH );
+
+			for ( std::size_t idx = 0; idx < run; ++idx )
+			{
+				low += data[idx];
+				high += low;
+			}
+
+			low %= MODULO;
+			high %= MODULO;
+
+			data += run;
+			size -= run;
+		}
+
+		return ( high << 16 ) | low;
+	}
+
+	// Computes the checksum of the first bytes of a file.
+	// Returns false if the file is shorter.
+	static bool
+	checksum_file(
+		int file_handle,
+		std::int64_t length,
+		std::uint32_t& checksum )
+	{
+	#ifdef __linux__
+		static constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+
+		std::vector< unsigned char > buffer( BUFFER_SIZE );
+
+		checksum = 1;
+
+		for ( std::int64_t position = 0; position < length; )
+		{
+			const auto bytes = ::pread( file_handle, buffer.data(), static_cast< std::size_t >( std::min< std::int64_t >( length - position, BUFFER_SIZE ) ), position );
+
+			if ( bytes <= 0 )
+			{
+				return false;
+			}
+
+			checksum = update_adler32( checksum, buffer.data(), static_cast< std::size_t >( bytes ) );
+			position += bytes;
+		}
+
+		return true;
+	#else
+		static_cast< void >( file_handle );
+		static_cast< void >( length );
+		static_cast< void >( checksum );
+
+		return false;
+	#endif
+	}
+
+	transfer_checkpoint::transfer_checkpoint( std::string const & filename ) :
+		path( filename + SUFFIX )
+	{
+	}
+
+	// Reads the sidecar file; returns false if there is none or if it is
+	// not a valid checkpoint
+	bool
+	transfer_checkpoint::load()
+	{
+		auto* file = std::fopen( this->path.c_str(), "r" );
+
+		if ( file == nullptr )
+		{
+			return false;
+		}
+
+		std::int64_t size = 0;
+		std::int64_t position = 0;
+		std::uint32_t sum = 0;
+
+		const auto fields = std::fscanf( file, "%" SCNd64 " %" SCNd64 " %" SCNx32, &size, &position, &sum );
+
+		std::fclose( file );
+
+		if ( ( fields != 3 ) || ( position < 0 ) || ( ( size >= 0 ) && ( position > size ) ) )
+		{
+			return false;
+		}
+
+		this->file_size = size;
+		this->offset = position;
+		this->checksum = sum;
+
+		return true;
+	}
+
+	// Writes the sidecar file. It is replaced as a whole, so that an
+	// interruption leaves either the previous or the new checkpoint.
+	bool
+	transfer_checkpoint::save() const
+	{
+		const auto temporary_path = this->path + ".tmp";
+
+		auto* file = std::fopen( temporary_path.c_str(), "w" );
+
+		if ( file == nullptr )
+		{
+			return false;
+		}
+
+		const auto written = std::fprintf( file, "%" PRId64 " %" PRId64 " %08" PRIx32 "\n", this->file_size, this->offset, this->checksum ) > 0;
+
+		if ( ( std::fclose( file ) != 0 ) || !written )
+		{
+			std::remove( temporary_path.c_str() );
+
+			return false;
+		}
+
+		return std::rename( temporary_path.c_str(), this->path.c_str() ) == 0;
+	}
+
+	// Deletes the sidecar file once the transfer is complete
+	void
+	transfer_checkpoint::remove() const
+	{
+		std::remove( this->path.c_str() );
+	}
+
+	// Starts over from the beginning of a file of the given size
+	void
+	transfer_checkpoint::reset( std::int64_t file_size ) noexcept
+	{
+		this->file_size = file_size;
+		this->offset = 0;
+		this->checksum = 1;
+	}
+
+	// Accounts for bytes transferred past the offset
+	void
+	transfer_checkpoint::update(
+		void const * data,
+		std::size_t size ) noexcept
+	{
+		this->checksum = update_adler32( this->checksum, static_cast< unsigned char const * >( data ), size );
+		this->offset += static_cast< std::int64_t >( size );
+	}
+
+	// Checks that the local file still holds the bytes the checkpoint covers
+	bool
+	transfer_checkpoint::verify( int file_handle ) const
+	{
+		std::uint32_t sum = 0;
+
+		return checksum_file( file_handle, this->offset, sum ) && ( sum == this->checksum );
+	}
+
+	// Moves the offset back, for instance to the size the server actually
+	// stored, and recomputes the checksum of the local bytes before it
+	bool
+	transfer_checkpoint::rewind(
+		int file_handle,
+		std::int64_t offset )
+	{
+		if ( ( offset < 0 ) || ( offset > this->offset ) )
+		{
+			return false;
+		}
+
+		if ( offset == this->offset )
+		{
+			return true;
+		}
+
+		std::uint32_t sum = 0;
+
+		if ( !checksum_file( file_handle, offset, sum ) )
+		{
+			return false;
+		}
+
+		this->offset = offset;
+		this->checksum = sum;
+
+		return true;
+	}
+
+	std::int64_t
+	transfer_checkpoint::get_file_size() const noexcept
+	{
+		return this->file_size;
+	}
+
+	std::int64_t
+	transfer_checkpoint::get_offset() const noexcept
+	{
+		return this->offset;
+	}
+}
@@ -0,0 +1,201 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "transfer_engine.hpp"
+#include "uring_transfer_engine.hpp"
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <errno.h>
+#elif _WIN32
+	#include <io.h>
+#endif
+
+#include <iostream>
+#include <new>
+
+namespace networking
+{
+	// Creates the requested engine, falling back to the standard
+	// engine when the requested one cannot be set up
+	std::unique_ptr< transfer_engine >
+	transfer_engine::create( transfer_engine_kind kind )
+	{
+		if ( kind == transfer_engine_kind::io_uring )
+		{
+			std::unique_ptr< uring_transfer_engine > engine( new ( std::nothrow ) uring_transfer_engine() );
+
+			if ( engine && engine->is_open() )
+			{
+				return engine;
+			}
+
+			std::cerr << "io_uring is unavailable; using the standard transfer engine." << std::endl;
+		}
+
+		return std::unique_ptr< transfer_engine >( new standard_transfer_engine() );
+	}
+
+	transfer_engine_kind
+	standard_transfer_engine::get_kind() const noexcept
+	{
+		return transfer_engine_kind::standard;
+	}
+
+	// Receives data until the partner socket closes and writes it to the file.
+	// Regular files are filled by the kernel with splice; other files, or
+	// systems without splice, go through the intermediate buffer.
+	std::int64_t
+	standard_transfer_engine::receive_to_file(
+		socket const & source,
+		int file_handle ) noexcept
+	{
+	#ifdef __linux__
+		struct stat file_status = {};
+
+		const auto flags = ::fcntl( file_handle, F_GETFL );
+
+		if ( ( flags != -1 ) &&
+			 ( ( flags & O_APPEND ) == 0 ) &&
+			 ( ::fstat( file_handle, &file_status ) == 0 ) &&
+			 S_ISREG( file_status.st_mode ) )
+		{
+			return source.receive_to_file( file_handle );
+		}
+	#endif
+
+		std::unique_ptr< char[] > buffer( new ( std::nothrow ) char[BUFFER_SIZE] );
+
+		if ( !buffer )
+		{
+			return -1;
+		}
+
+		std::int64_t total = 0;
+
+		while ( true )
+		{
+			const auto bytes_received = source.receive_message( static_cast< void* >( buffer.get() ), BUFFER_SIZE );
+
+			if ( bytes_received == 0 )
+			{
+				break;
+			}
+
+			// Only the server closing the connection ends the file
+			if ( bytes_received < 0 )
+			{
+				return -1;
+			}
+
+			for ( auto written = 0; written < bytes_received; )
+			{
+			#ifdef __linux__
+				const auto bytes_written = ::write( file_handle, buffer.get() + written, bytes_received - written );
+
+				if ( ( bytes_written == -1 ) && ( errno == EINTR ) )
+				{
+					continue;
+				}
+			#elif _WIN32
+				const auto bytes_written = ::_write( file_handle, buffer.get() + written, bytes_received - written );
+			#endif
+
+				if ( bytes_written <= 0 )
+				{
+					std::cerr << "Failed to write to the local file.";
+					return -1;
+				}
+
+				written += static_cast< int >( bytes_written );
+			}
+
+			total += bytes_received;
+		}
+
+		return total;
+	}
+
+	// Reads the file up to its end and sends it to the partner socket.
+	// Regular files are pushed by the kernel with sendfile; other files,
+	// or systems without sendfile, go through the intermediate buffer.
+	std::int64_t
+	standard_transfer_engine::send_from_file(
+		int file_handle,
+		socket const & sink ) noexcept
+	{
+	#ifdef __linux__
+		struct stat file_status = {};
+
+		const auto start = ::lseek( file_handle, 0, SEEK_CUR );
+
+		if ( ( start != -1 ) &&
+			 ( ::fstat( file_handle, &file_status ) == 0 ) &&
+			 S_ISREG( file_status.st_mode ) &&
+			 ( file_status.st_size >= start ) )
+		{
+			const auto size = static_cast< std::uint64_t >( file_status.st_size - start );
+			const auto bytes_sent = sink.send_file( file_handle, size );
+
+			if ( bytes_sent >= 0 )
+			{
+				return ( static_cast< std::uint64_t >( bytes_sent ) == size ) ? bytes_sent : -1;
+			}
+		}
+	#endif
+
+		std::unique_ptr< char[] > buffer( new ( std::nothrow ) char[BUFFER_SIZE] );
+
+		if ( !buffer )
+		{
+			return -1;
+		}
+
+		std::int64_t total = 0;
+
+		while ( true )
+		{
+		#ifdef __linux__
+			const auto bytes_read = ::read( file_handle, buffer.get(), BUFFER_SIZE );
+
+			if ( ( bytes_read == -1 ) && ( errno == EINTR ) )
+			{
+				continue;
+			}
+		#elif _WIN32
+			const auto bytes_read = ::_read( file_handle, buffer.get(), BUFFER_SIZE );
+		#endif
+
+			if ( bytes_read < 0 )
+			{
+				std::cerr << "Failed to read from the local file.";
+				return -1;
+			}
+
+			if ( bytes_read == 0 )
+			{
+				break;
+			}
+
+			for ( auto sent = 0; sent < bytes_read; )
+			{
+				const auto bytes_sent = sink.send_message( static_cast< void* >( buffer.get() + sent ), bytes_read - sent );
+
+				if ( bytes_sent <= 0 )
+				{
+					return -1;
+				}
+
+				sent += bytes_sent;
+			}
+
+			total += bytes_read;
+		}
+
+		return total;
+	}
+}
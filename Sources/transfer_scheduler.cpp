@@ -0,0 +1,631 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "transfer_scheduler.hpp"
+#include "ftp_processor.hpp"
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __linux__
+	#include <fnmatch.h>
+	#include <glob.h>
+	#include <sys/stat.h>
+#endif
+
+namespace networking
+{
+	// Additional sessions opened by schedulers, by server, and the limit of
+	// sessions per server, shared by all schedulers of the process
+	static std::mutex server_sessions_mutex;
+	static std::unordered_map< std::string, std::size_t > server_sessions;
+	static std::size_t server_limit = transfer_scheduler::DEFAULT_SERVER_LIMIT;
+
+	// Reserves up to the wanted number of additional sessions to a server.
+	// The origin session counts towards the limit but is never refused.
+	static std::size_t
+	reserve_server_sessions(
+		std::string const & server,
+		std::size_t wanted )
+	{
+		std::lock_guard< std::mutex > lock( server_sessions_mutex );
+
+		auto& in_use = server_sessions[server];
+
+		const auto available = ( server_limit > in_use + 1 ) ? ( server_limit - in_use - 1 ) : 0;
+		const auto reserved = std::min( wanted, available );
+
+		in_use += reserved;
+
+		return reserved;
+	}
+
+	static void
+	release_server_sessions(
+		std::string const & server,
+		std::size_t count )
+	{
+		std::lock_guard< std::mutex > lock( server_sessions_mutex );
+
+		auto it = server_sessions.find( server );
+
+		if ( it != server_sessions.end() )
+		{
+			it->second -= std::min( it->second, count );
+
+			if ( it->second == 0 )
+			{
+				server_sessions.erase( it );
+			}
+		}
+	}
+
+	transfer_scheduler::transfer_scheduler(
+		ftp_processor& origin,
+		std::size_t session_count ) :
+		origin( origin ),
+		session_count( std::max< std::size_t >( session_count, 1 ) )
+	{
+	}
+
+	// Sets the number of sessions schedulers may open to a server at once
+	void
+	transfer_scheduler::set_server_limit( std::size_t limit ) noexcept
+	{
+		std::lock_guard< std::mutex > lock( server_sessions_mutex );
+
+		server_limit = std::max< std::size_t >( limit, 1 );
+	}
+
+	// Downloads the files matching the patterns into the current local
+	// directory, under their base name. A pattern with wildcards (*, ? or
+	// [...]) is matched against the files of its directory on the server;
+	// any other pattern names a single file.
+	// Returns false if any file could not be retrieved; patterns matching
+	// no file are reported apart and are not failures.
+	bool
+	transfer_scheduler::get_files( std::vector< std::string > const & patterns )
+	{
+		// Expected SIZE command reply
+		static constexpr auto FILE_STATUS_OK = 213;
+
+		this->failed_files.clear();
+		this->unmatched_patterns.clear();
+		this->transferred_files = 0;
+
+		std::vector< job > jobs;
+		// Sizes of the files named literally, asked for in one pipeline
+		std::vector< pipelined_command > size_commands;
+
+	#ifdef __linux__
+		for ( auto const & pattern : patterns )
+		{
+			if ( pattern.find_first_of( "*?[" ) == std::string::npos )
+			{
+				pipelined_command command;
+				command.command = "SIZE";
+				command.parameter = pattern;
+
+				size_commands.push_back( std::move( command ) );
+
+				continue;
+			}
+
+			const auto separator = pattern.find_last_of( '/' );
+			const auto directory = ( separator == std::string::npos ) ? std::string() : pattern.substr( 0, separator );
+			const auto prefix = ( separator == std::string::npos ) ? std::string() : pattern.substr( 0, separator + 1 );
+			const auto name_pattern = pattern.substr( prefix.size() );
+
+			std::vector< remote_file > files;
+
+			if ( !this->origin.list_files( directory, files ) )
+			{
+				this->add_failure( pattern );
+
+				continue;
+			}
+
+			const auto matched_files = jobs.size();
+
+			for ( auto const & file : files )
+			{
+				if ( ::fnmatch( name_pattern.c_str(), file.name.c_str(), 0 ) == 0 )
+				{
+					jobs.push_back( { prefix + file.name, std::max< std::int64_t >( file.size, 0 ) } );
+				}
+			}
+
+			if ( jobs.size() == matched_files )
+			{
+				this->unmatched_patterns.push_back( pattern );
+			}
+		}
+	#endif
+
+		this->origin.pipeline_commands( size_commands );
+
+		for ( auto const & command : size_commands )
+		{
+			// Unknown sizes are queued last
+			std::int64_t size = 0;
+
+			if ( ( command.reply_code == FILE_STATUS_OK ) && ( command.reply.size() > 4 ) )
+			{
+				std::from_chars( command.reply.data() + 4, command.reply.data() + command.reply.size(), size );
+			}
+
+			jobs.push_back( { command.parameter, std::max< std::int64_t >( size, 0 ) } );
+		}
+
+		return this->run( std::move( jobs ), false ) && this->failed_files.empty();
+	}
+
+	// Uploads the local files matching the patterns, expanded as by the shell.
+	// Returns false if any file could not be sent; patterns matching no file
+	// are reported apart and are not failures.
+	bool
+	transfer_scheduler::put_files( std::vector< std::string > const & patterns )
+	{
+		this->failed_files.clear();
+		this->unmatched_patterns.clear();
+		this->transferred_files = 0;
+
+		std::vector< job > jobs;
+
+	#ifdef __linux__
+		for ( auto const & pattern : patterns )
+		{
+			glob_t matches;
+
+			const auto result = ::glob( pattern.c_str(), 0, nullptr, &matches );
+
+			if ( result == GLOB_NOMATCH )
+			{
+				this->unmatched_patterns.push_back( pattern );
+
+				continue;
+			}
+
+			if ( result != 0 )
+			{
+				this->add_failure( pattern );
+
+				continue;
+			}
+
+			for ( std::size_t idx = 0; idx < matches.gl_pathc; ++idx )
+			{
+				struct stat file_status;
+
+				// Directories are not uploaded
+				if ( ( ::stat( matches.gl_pathv[idx], &file_status ) == 0 ) && S_ISREG( file_status.st_mode ) )
+				{
+					jobs.push_back( { matches.gl_pathv[idx], file_status.st_size } );
+				}
+			}
+
+			::globfree( &matches );
+		}
+	#endif
+
+		return this->run( std::move( jobs ), true ) && this->failed_files.empty();
+	}
+
+	// Cancels the running batch: the transfers in progress on every session
+	// are cancelled, and no further file is started; the files left are
+	// reported as failed. Returns false if no batch is running.
+	// Only makes system calls, so it may be called from a signal handler.
+	bool
+	transfer_scheduler::cancel() noexcept
+	{
+		if ( this->running == 0 )
+		{
+			return false;
+		}
+
+		this->cancelled = 1;
+		this->origin.cancel_transfer();
+
+		for ( auto& session : this->sessions )
+		{
+			session.cancel_transfer();
+		}
+
+		return true;
+	}
+
+	// Returns the number of files moved by the last call
+	std::size_t
+	transfer_scheduler::get_transferred_files() const noexcept
+	{
+		return this->transferred_files;
+	}
+
+	// Returns the files, or patterns, the last call failed to move
+	std::vector< std::string > const &
+	transfer_scheduler::get_failed_files() const noexcept
+	{
+		return this->failed_files;
+	}
+
+	// Returns the patterns of the last call that matched no file
+	std::vector< std::string > const &
+	transfer_scheduler::get_unmatched_patterns() const noexcept
+	{
+		return this->unmatched_patterns;
+	}
+
+	// Deals the files out to the sessions and runs them until every queue
+	// is empty
+	bool
+	transfer_scheduler::run(
+		std::vector< job > jobs,
+		bool uploading )
+	{
+		if ( jobs.empty() )
+		{
+			return true;
+		}
+
+		std::stable_sort( jobs.begin(), jobs.end(), []( job const & first, job const & second )
+		{
+			return first.size > second.size;
+		} );
+
+		const auto server = this->origin.get_host_address();
+		const auto additional_sessions = reserve_server_sessions( server, std::min( this->session_count, jobs.size() ) - 1 );
+
+		this->queues.clear();
+
+		for ( std::size_t idx = 0; idx <= additional_sessions; ++idx )
+		{
+			this->queues.emplace_back();
+		}
+
+		for ( auto& next : jobs )
+		{
+			auto& shortest = *std::min_element( this->queues.begin(), this->queues.end(), []( queue const & first, queue const & second )
+			{
+				return first.queued_bytes < second.queued_bytes;
+			} );
+
+			shortest.queued_bytes += next.size;
+			shortest.jobs.push_back( std::move( next ) );
+		}
+
+		// Further sessions start in the directory of the origin session,
+		// with the same transfer type
+		std::string directory;
+		this->origin.get_working_directory( directory );
+
+		const auto transfer_type = this->origin.get_transfer_type();
+
+		// Every session is in place before the batch can be cancelled
+		this->sessions.clear();
+		this->sessions.resize( additional_sessions );
+		this->cancelled = 0;
+		this->running = 1;
+
+		// Stream transfers run on a reactor, from this thread; the others
+		// need a thread per session
+		reactor events;
+
+		if ( events.is_open() &&
+			 !this->origin.is_block_mode() &&
+			 !this->origin.is_compressed_mode() &&
+			 !this->origin.is_resumable() &&
+			 ( this->origin.get_transfer_engine() == transfer_engine_kind::standard ) )
+		{
+			this->run_reactor( events, directory, transfer_type, uploading );
+		}
+		else
+		{
+			this->run_threads( directory, transfer_type, uploading );
+		}
+
+		this->running = 0;
+		this->sessions.clear();
+
+		release_server_sessions( server, additional_sessions );
+
+		// Files left behind by sessions that all lost their connection
+		for ( auto& remaining : this->queues )
+		{
+			for ( auto const & left : remaining.jobs )
+			{
+				this->add_failure( left.filename );
+			}
+		}
+
+		return true;
+	}
+
+	// Runs every session on its own thread, the origin session on the
+	// calling one
+	void
+	transfer_scheduler::run_threads(
+		std::string const & directory,
+		bool transfer_type,
+		bool uploading )
+	{
+		std::vector< std::thread > threads;
+
+		for ( std::size_t idx = 1; idx < this->queues.size(); ++idx )
+		{
+			threads.emplace_back( [this, &directory, transfer_type, idx, uploading]()
+			{
+				auto& session = this->sessions[idx - 1];
+
+				// A session that cannot log in leaves its queue to the others
+				if ( session.connect_session( this->origin, directory ) &&
+					 session.set_transfer_type( transfer_type ) )
+				{
+					session.set_pasv_prefetch( true );
+
+					this->run_session( session, idx, uploading );
+				}
+
+				session.terminate();
+			} );
+		}
+
+		// Each transfer of the batch prepares the data connection of the next.
+		// Restoring the setting releases the connection prepared by the last
+		// one, unless prefetching was already on.
+		const auto pasv_prefetch = this->origin.is_pasv_prefetch();
+		this->origin.set_pasv_prefetch( true );
+
+		this->run_session( this->origin, 0, uploading );
+
+		this->origin.set_pasv_prefetch( pasv_prefetch );
+
+		for ( auto& thread : threads )
+		{
+			thread.join();
+		}
+	}
+
+	// Runs every session from the calling thread. The further sessions log
+	// in on their own threads; then every session is attached to the
+	// reactor, and each transfer that ends starts the next one of its
+	// session, so that the transfers of all sessions progress together.
+	void
+	transfer_scheduler::run_reactor(
+		reactor& events,
+		std::string const & directory,
+		bool transfer_type,
+		bool uploading )
+	{
+		// Whether each further session logged in
+		std::unique_ptr< bool[] > logged_in( new bool[this->sessions.size()]() );
+
+		{
+			std::vector< std::thread > threads;
+
+			for ( std::size_t idx = 1; idx < this->queues.size(); ++idx )
+			{
+				threads.emplace_back( [this, &directory, &logged_in, transfer_type, idx]()
+				{
+					auto& session = this->sessions[idx - 1];
+
+					logged_in[idx - 1] = session.connect_session( this->origin, directory ) &&
+						session.set_transfer_type( transfer_type );
+				} );
+			}
+
+			for ( auto& thread : threads )
+			{
+				thread.join();
+			}
+		}
+
+		// Started transfers open their own data connection
+		const auto pasv_prefetch = this->origin.is_pasv_prefetch();
+		this->origin.set_pasv_prefetch( false );
+
+		// Transfers in progress, and the file of each session
+		std::size_t active = 0;
+		std::vector< std::string > started_files( this->queues.size() );
+
+		// Starts the next file of the session; a session that lost its
+		// connection leaves the rest to the others
+		std::function< void( ftp_processor&, std::size_t ) > start_next;
+
+		start_next = [this, uploading, &active, &started_files, &start_next]( ftp_processor& session, std::size_t index )
+		{
+			job next;
+
+			while ( session.is_connected() && this->next_job( index, next ) )
+			{
+				// Downloads land in the current local directory
+				const auto separator = next.filename.find_last_of( '/' );
+				const auto local_filename = ( separator == std::string::npos ) ? next.filename : next.filename.substr( separator + 1 );
+
+				auto handler = [this, &active, &started_files, &start_next, &session, index]( bool succeeded )
+				{
+					--active;
+
+					if ( succeeded )
+					{
+						++this->transferred_files;
+					}
+					else
+					{
+						this->add_failure( started_files[index] );
+					}
+
+					start_next( session, index );
+				};
+
+				const auto started = uploading ?
+					session.start_put_file( next.filename, std::move( handler ) ) :
+					session.start_get_file( next.filename, local_filename, std::move( handler ) );
+
+				if ( started )
+				{
+					++active;
+					started_files[index] = next.filename;
+
+					return;
+				}
+
+				this->add_failure( next.filename );
+			}
+		};
+
+		// The origin session is the one of queue 0
+		std::vector< std::pair< ftp_processor*, std::size_t > > attached;
+
+		if ( this->origin.attach( events ) )
+		{
+			attached.emplace_back( &this->origin, 0 );
+		}
+
+		for ( std::size_t idx = 1; idx < this->queues.size(); ++idx )
+		{
+			if ( logged_in[idx - 1] && this->sessions[idx - 1].attach( events ) )
+			{
+				attached.emplace_back( &this->sessions[idx - 1], idx );
+			}
+		}
+
+		for ( auto const & session : attached )
+		{
+			start_next( *session.first, session.second );
+		}
+
+		// A cancellation interrupts the poll; the transfers in progress
+		// are then aborted as their sessions are detached
+		while ( ( active > 0 ) && ( this->cancelled == 0 ) && ( events.poll( -1 ) != -1 ) )
+		{
+		}
+
+		// Transfers still in progress fail
+		for ( auto const & session : attached )
+		{
+			if ( session.first->is_transfer_started() )
+			{
+				this->add_failure( started_files[session.second] );
+			}
+
+			session.first->detach();
+		}
+
+		this->origin.set_pasv_prefetch( pasv_prefetch );
+
+		for ( auto& session : this->sessions )
+		{
+			session.terminate();
+		}
+	}
+
+	// Transfers files over one session until every queue is empty
+	void
+	transfer_scheduler::run_session(
+		ftp_processor& session,
+		std::size_t index,
+		bool uploading )
+	{
+		job next;
+
+		while ( this->next_job( index, next ) )
+		{
+			// Downloads land in the current local directory
+			const auto separator = next.filename.find_last_of( '/' );
+			const auto local_filename = ( separator == std::string::npos ) ? next.filename : next.filename.substr( separator + 1 );
+
+			const auto success = uploading ? session.put_file( next.filename ) : session.get_file( next.filename, local_filename );
+
+			if ( success )
+			{
+				++this->transferred_files;
+			}
+			else
+			{
+				this->add_failure( next.filename );
+
+				// A session that lost its connection leaves the rest to the others
+				if ( !session.is_connected() )
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	// Takes the largest file of the session's own queue or, once it is
+	// empty, the smallest file of the queue with the most bytes left
+	bool
+	transfer_scheduler::next_job(
+		std::size_t index,
+		job& next )
+	{
+		if ( this->cancelled != 0 )
+		{
+			return false;
+		}
+
+		{
+			auto& own = this->queues[index];
+			std::lock_guard< std::mutex > lock( own.mutex );
+
+			if ( !own.jobs.empty() )
+			{
+				next = std::move( own.jobs.front() );
+				own.jobs.pop_front();
+				own.queued_bytes -= next.size;
+
+				return true;
+			}
+		}
+
+		while ( true )
+		{
+			queue* fullest = nullptr;
+			std::int64_t fullest_bytes = -1;
+
+			for ( auto& victim : this->queues )
+			{
+				std::lock_guard< std::mutex > lock( victim.mutex );
+
+				if ( !victim.jobs.empty() && ( victim.queued_bytes > fullest_bytes ) )
+				{
+					fullest = &victim;
+					fullest_bytes = victim.queued_bytes;
+				}
+			}
+
+			if ( fullest == nullptr )
+			{
+				return false;
+			}
+
+			std::lock_guard< std::mutex > lock( fullest->mutex );
+
+			// Emptied meanwhile by its owner; look again
+			if ( !fullest->jobs.empty() )
+			{
+				next = std::move( fullest->jobs.back() );
+				fullest->jobs.pop_back();
+				fullest->queued_bytes -= next.size;
+
+				return true;
+			}
+		}
+	}
+
+	void
+	transfer_scheduler::add_failure( std::string const & filename )
+	{
+		std::lock_guard< std::mutex > lock( this->failed_files_mutex );
+
+		this->failed_files.push_back( filename );
+	}
+}
@@ -0,0 +1,614 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "uring_transfer_engine.hpp"
+
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+	#include <errno.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <new>
+
+namespace networking
+{
+#ifdef __linux__
+	// Minimal io_uring instance: the shared submission and completion
+	// rings, plus the buffers registered with the kernel.
+	struct uring_transfer_engine::ring
+	{
+		ring() = default;
+		~ring() noexcept;
+
+		ring( ring const & ) = delete;
+		ring& operator=( ring const & ) = delete;
+
+		bool open( unsigned depth ) noexcept;
+		bool supports_transfers() const noexcept;
+		io_uring_sqe* next_entry() noexcept;
+		bool submit_and_wait(
+			unsigned count,
+			int* results ) noexcept;
+		unsigned reap( int* results ) noexcept;
+		char* buffer( std::size_t index ) const noexcept;
+
+		// Ring file descriptor
+		int handle = -1;
+		// Shared memory regions
+		void* submission_map = MAP_FAILED;
+		std::size_t submission_map_size = 0;
+		void* completion_map = MAP_FAILED;
+		std::size_t completion_map_size = 0;
+		io_uring_sqe* entries = static_cast< io_uring_sqe* >( MAP_FAILED );
+		std::size_t entries_size = 0;
+		// Submission ring
+		unsigned* submission_tail = nullptr;
+		unsigned* submission_mask = nullptr;
+		unsigned* submission_array = nullptr;
+		unsigned tail = 0;
+		// Completion ring
+		unsigned* completion_head = nullptr;
+		unsigned* completion_tail = nullptr;
+		unsigned* completion_mask = nullptr;
+		io_uring_cqe* completions = nullptr;
+		// Transfer buffers
+		std::unique_ptr< char[] > buffers;
+		// True when the buffers are registered with the kernel
+		bool fixed_buffers = false;
+	};
+
+	uring_transfer_engine::ring::~ring() noexcept
+	{
+		if ( this->entries != MAP_FAILED )
+		{
+			::munmap( this->entries, this->entries_size );
+		}
+
+		if ( ( this->completion_map != MAP_FAILED ) && ( this->completion_map != this->submission_map ) )
+		{
+			::munmap( this->completion_map, this->completion_map_size );
+		}
+
+		if ( this->submission_map != MAP_FAILED )
+		{
+			::munmap( this->submission_map, this->submission_map_size );
+		}
+
+		if ( this->handle != -1 )
+		{
+			::close( this->handle );
+		}
+	}
+
+	// Creates the ring, checks its operations, maps its shared memory and
+	// registers the buffers
+	bool
+	uring_transfer_engine::ring::open( unsigned depth ) noexcept
+	{
+		io_uring_params parameters = {};
+
+		this->handle = static_cast< int >( ::syscall( __NR_io_uring_setup, depth, &parameters ) );
+
+		if ( this->handle == -1 )
+		{
+			return false;
+		}
+
+		if ( !this->supports_transfers() )
+		{
+			return false;
+		}
+
+		this->submission_map_size = parameters.sq_off.array + parameters.sq_entries * sizeof( unsigned );
+		this->completion_map_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof( io_uring_cqe );
+
+		const bool single_map = ( parameters.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+
+		if ( single_map )
+		{
+			this->submission_map_size = std::max( this->submission_map_size, this->completion_map_size );
+			this->completion_map_size = this->submission_map_size;
+		}
+
+		this->submission_map = ::mmap( nullptr, this->submission_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->handle, IORING_OFF_SQ_RING );
+
+		if ( this->submission_map == MAP_FAILED )
+		{
+			return false;
+		}
+
+		this->completion_map = single_map ?
+			this->submission_map :
+			::mmap( nullptr, this->completion_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->handle, IORING_OFF_CQ_RING );
+
+		if ( this->completion_map == MAP_FAILED )
+		{
+			return false;
+		}
+
+		this->entries_size = parameters.sq_entries * sizeof( io_uring_sqe );
+		this->entries = static_cast< io_uring_sqe* >(
+			::mmap( nullptr, this->entries_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->handle, IORING_OFF_SQES ) );
+
+		if ( this->entries == MAP_FAILED )
+		{
+			return false;
+		}
+
+		auto* submission_base = static_cast< char* >( this->submission_map );
+		this->submission_tail = reinterpret_cast< unsigned* >( submission_base + parameters.sq_off.tail );
+		this->submission_mask = reinterpret_cast< unsigned* >( submission_base + parameters.sq_off.ring_mask );
+		this->submission_array = reinterpret_cast< unsigned* >( submission_base + parameters.sq_off.array );
+		this->tail = *this->submission_tail;
+
+		auto* completion_base = static_cast< char* >( this->completion_map );
+		this->completion_head = reinterpret_cast< unsigned* >( completion_base + parameters.cq_off.head );
+		this->completion_tail = reinterpret_cast< unsigned* >( completion_base + parameters.cq_off.tail );
+		this->completion_mask = reinterpret_cast< unsigned* >( completion_base + parameters.cq_off.ring_mask );
+		this->completions = reinterpret_cast< io_uring_cqe* >( completion_base + parameters.cq_off.cqes );
+
+		this->buffers.reset( new ( std::nothrow ) char[BUFFER_SIZE * BUFFER_COUNT] );
+
+		if ( !this->buffers )
+		{
+			return false;
+		}
+
+		// Registration may fail (e.g. locked memory limits); plain reads
+		// and writes are then used on the same buffers.
+		std::array< iovec, BUFFER_COUNT > vectors;
+
+		for ( std::size_t idx = 0; idx < BUFFER_COUNT; ++idx )
+		{
+			vectors[idx].iov_base = this->buffer( idx );
+			vectors[idx].iov_len = BUFFER_SIZE;
+		}
+
+		this->fixed_buffers = ::syscall( __NR_io_uring_register, this->handle, IORING_REGISTER_BUFFERS, vectors.data(), BUFFER_COUNT ) == 0;
+
+		return true;
+	}
+
+	// Whether the kernel implements every operation of the transfers.
+	// Rings predating the probe lack some of them (e.g. IORING_OP_RECV)
+	// and would fail each transfer at its first submission.
+	bool
+	uring_transfer_engine::ring::supports_transfers() const noexcept
+	{
+		static constexpr unsigned OPERATION_COUNT = 256;
+
+		std::unique_ptr< char[] > storage( new ( std::nothrow ) char[sizeof( io_uring_probe ) + OPERATION_COUNT * sizeof( io_uring_probe_op )]() );
+
+		if ( !storage )
+		{
+			return false;
+		}
+
+		auto* probe = reinterpret_cast< io_uring_probe* >( storage.get() );
+
+		if ( ::syscall( __NR_io_uring_register, this->handle, IORING_REGISTER_PROBE, probe, OPERATION_COUNT ) != 0 )
+		{
+			return false;
+		}
+
+		for ( const auto operation : { IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED } )
+		{
+			if ( ( operation > probe->last_op ) || ( ( probe->ops[operation].flags & IO_URING_OP_SUPPORTED ) == 0 ) )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Returns the next free, zeroed submission entry
+	io_uring_sqe*
+	uring_transfer_engine::ring::next_entry() noexcept
+	{
+		const auto index = this->tail & *this->submission_mask;
+		auto* entry = &this->entries[index];
+
+		std::fill( reinterpret_cast< char* >( entry ), reinterpret_cast< char* >( entry + 1 ), 0 );
+
+		this->submission_array[index] = index;
+		++this->tail;
+
+		return entry;
+	}
+
+	// Submits the queued entries and waits for all their completions;
+	// results are indexed by the user data of each entry.
+	bool
+	uring_transfer_engine::ring::submit_and_wait(
+		unsigned count,
+		int* results ) noexcept
+	{
+		__atomic_store_n( this->submission_tail, this->tail, __ATOMIC_RELEASE );
+
+		unsigned submitted = 0;
+		unsigned completed = 0;
+
+		while ( completed < count )
+		{
+			const auto entered = ::syscall( __NR_io_uring_enter, this->handle, count - submitted, count - completed, IORING_ENTER_GETEVENTS, nullptr, 0 );
+
+			if ( entered == -1 )
+			{
+				if ( ( errno != EINTR ) && ( errno != EAGAIN ) && ( errno != EBUSY ) )
+				{
+					std::cerr << "Failed to submit io_uring requests.";
+					return false;
+				}
+			}
+			else
+			{
+				submitted += static_cast< unsigned >( entered );
+			}
+
+			completed += this->reap( results );
+		}
+
+		return true;
+	}
+
+	// Consumes the available completions
+	unsigned
+	uring_transfer_engine::ring::reap( int* results ) noexcept
+	{
+		auto head = *this->completion_head;
+		const auto completion_tail = __atomic_load_n( this->completion_tail, __ATOMIC_ACQUIRE );
+
+		unsigned reaped = 0;
+
+		for ( ; head != completion_tail; ++head, ++reaped )
+		{
+			const auto& completion = this->completions[head & *this->completion_mask];
+
+			results[completion.user_data] = completion.res;
+		}
+
+		__atomic_store_n( this->completion_head, head, __ATOMIC_RELEASE );
+
+		return reaped;
+	}
+
+	char*
+	uring_transfer_engine::ring::buffer( std::size_t index ) const noexcept
+	{
+		return this->buffers.get() + index * BUFFER_SIZE;
+	}
+
+	// Writes the whole buffer at the given file offset
+	static bool
+	write_all(
+		int file_handle,
+		char const * buffer,
+		std::size_t size,
+		off_t offset ) noexcept
+	{
+		while ( size > 0 )
+		{
+			const auto bytes_written = ::pwrite( file_handle, buffer, size, offset );
+
+			if ( bytes_written <= 0 )
+			{
+				if ( ( bytes_written == -1 ) && ( errno == EINTR ) )
+				{
+					continue;
+				}
+
+				std::cerr << "Failed to write to the local file.";
+				return false;
+			}
+
+			buffer += bytes_written;
+			size -= static_cast< std::size_t >( bytes_written );
+			offset += bytes_written;
+		}
+
+		return true;
+	}
+#endif
+
+	uring_transfer_engine::uring_transfer_engine() noexcept
+	{
+	#ifdef __linux__
+		// Each chain holds a read and a write per buffer
+		static constexpr unsigned ring_depth = 2 * BUFFER_COUNT;
+
+		this->uring.reset( new ( std::nothrow ) ring() );
+
+		if ( this->uring && !this->uring->open( ring_depth ) )
+		{
+			this->uring.reset();
+		}
+	#endif
+	}
+
+	uring_transfer_engine::~uring_transfer_engine() noexcept = default;
+
+	bool
+	uring_transfer_engine::is_open() const noexcept
+	{
+		return static_cast< bool >( this->uring );
+	}
+
+	transfer_engine_kind
+	uring_transfer_engine::get_kind() const noexcept
+	{
+		return transfer_engine_kind::io_uring;
+	}
+
+	// Receives data until the partner socket closes and writes it to the file.
+	// Every chain links a full-buffer receive to the write of that buffer at
+	// its expected offset; a short receive (end of stream) breaks the chain,
+	// and any buffer whose linked write did not land at the right offset is
+	// written again synchronously before the next chain.
+	std::int64_t
+	uring_transfer_engine::receive_to_file(
+		socket const & source,
+		int file_handle ) noexcept
+	{
+	#ifdef __linux__
+		if ( !this->is_open() )
+		{
+			return -1;
+		}
+
+		auto& uring = *this->uring;
+
+		const auto start = ::lseek( file_handle, 0, SEEK_CUR );
+
+		if ( start == -1 )
+		{
+			return -1;
+		}
+
+		std::array< int, 2 * BUFFER_COUNT > results;
+		std::int64_t total = 0;
+		bool finished = false;
+
+		while ( !finished )
+		{
+			const auto offset = start + total;
+
+			for ( std::size_t idx = 0; idx < BUFFER_COUNT; ++idx )
+			{
+				auto* receive = uring.next_entry();
+
+				receive->opcode = IORING_OP_RECV;
+				receive->flags = IOSQE_IO_LINK;
+				receive->fd = source.get_handle();
+				receive->addr = reinterpret_cast< std::uintptr_t >( uring.buffer( idx ) );
+				receive->len = BUFFER_SIZE;
+				receive->msg_flags = MSG_WAITALL;
+				receive->user_data = 2 * idx;
+
+				auto* write = uring.next_entry();
+
+				write->opcode = uring.fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+				write->flags = ( idx + 1 < BUFFER_COUNT ) ? IOSQE_IO_LINK : 0;
+				write->fd = file_handle;
+				write->off = offset + idx * BUFFER_SIZE;
+				write->addr = reinterpret_cast< std::uintptr_t >( uring.buffer( idx ) );
+				write->len = BUFFER_SIZE;
+				write->buf_index = static_cast< std::uint16_t >( idx );
+				write->user_data = 2 * idx + 1;
+			}
+
+			if ( !uring.submit_and_wait( 2 * BUFFER_COUNT, results.data() ) )
+			{
+				return -1;
+			}
+
+			auto chain_offset = offset;
+			bool aligned = true;
+
+			for ( std::size_t idx = 0; idx < BUFFER_COUNT; ++idx )
+			{
+				const auto bytes_received = results[2 * idx];
+				const auto bytes_written = results[2 * idx + 1];
+
+				if ( ( bytes_received == -ECANCELED ) || ( bytes_received == -EINTR ) || ( bytes_received == -EAGAIN ) )
+				{
+					// Resume from the first incomplete buffer in the next chain
+					break;
+				}
+
+				if ( bytes_received < 0 )
+				{
+					std::cerr << "Failed to receive data.";
+					return -1;
+				}
+
+				if ( bytes_received == 0 )
+				{
+					finished = true;
+					break;
+				}
+
+				if ( !aligned ||
+					 ( static_cast< std::size_t >( bytes_received ) != BUFFER_SIZE ) ||
+					 ( bytes_written != bytes_received ) )
+				{
+					if ( !write_all( file_handle, uring.buffer( idx ), bytes_received, chain_offset ) )
+					{
+						return -1;
+					}
+
+					aligned = false;
+				}
+
+				chain_offset += bytes_received;
+			}
+
+			total = chain_offset - start;
+		}
+
+		// Drop whatever the linked writes may have left past the end
+		if ( ( ::ftruncate( file_handle, start + total ) == -1 ) ||
+			 ( ::lseek( file_handle, start + total, SEEK_SET ) == -1 ) )
+		{
+			return -1;
+		}
+
+		return total;
+	#else
+		static_cast< void >( source );
+		static_cast< void >( file_handle );
+
+		return -1;
+	#endif
+	}
+
+	// Reads the file up to its end and sends it to the partner socket.
+	// Every chain links the read of a buffer to its send; the size of
+	// the file is known, so each read has an exact length.
+	std::int64_t
+	uring_transfer_engine::send_from_file(
+		int file_handle,
+		socket const & sink ) noexcept
+	{
+	#ifdef __linux__
+		if ( !this->is_open() )
+		{
+			return -1;
+		}
+
+		auto& uring = *this->uring;
+
+		struct stat file_status = {};
+
+		const auto start = ::lseek( file_handle, 0, SEEK_CUR );
+
+		if ( ( start == -1 ) || ( ::fstat( file_handle, &file_status ) == -1 ) )
+		{
+			return -1;
+		}
+
+		std::array< int, 2 * BUFFER_COUNT > results;
+		auto offset = start;
+
+		while ( offset < file_status.st_size )
+		{
+			std::array< std::size_t, BUFFER_COUNT > lengths;
+			std::size_t count = 0;
+
+			for ( ; ( count < BUFFER_COUNT ) && ( offset + static_cast< off_t >( count * BUFFER_SIZE ) < file_status.st_size ); ++count )
+			{
+				const auto chunk_offset = offset + static_cast< off_t >( count * BUFFER_SIZE );
+				lengths[count] = std::min( BUFFER_SIZE, static_cast< std::size_t >( file_status.st_size - chunk_offset ) );
+
+				auto* read = uring.next_entry();
+
+				read->opcode = uring.fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+				read->flags = IOSQE_IO_LINK;
+				read->fd = file_handle;
+				read->off = chunk_offset;
+				read->addr = reinterpret_cast< std::uintptr_t >( uring.buffer( count ) );
+				read->len = static_cast< std::uint32_t >( lengths[count] );
+				read->buf_index = static_cast< std::uint16_t >( count );
+				read->user_data = 2 * count;
+
+				auto* send = uring.next_entry();
+
+				send->opcode = IORING_OP_SEND;
+				send->flags = IOSQE_IO_LINK;
+				send->fd = sink.get_handle();
+				send->addr = reinterpret_cast< std::uintptr_t >( uring.buffer( count ) );
+				send->len = static_cast< std::uint32_t >( lengths[count] );
+				send->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+				send->user_data = 2 * count + 1;
+			}
+
+			// The chain ends with the last send
+			uring.entries[( uring.tail - 1 ) & *uring.submission_mask].flags = 0;
+
+			if ( !uring.submit_and_wait( static_cast< unsigned >( 2 * count ), results.data() ) )
+			{
+				return -1;
+			}
+
+			for ( std::size_t idx = 0; idx < count; ++idx )
+			{
+				const auto bytes_read = results[2 * idx];
+				const auto bytes_sent = results[2 * idx + 1];
+
+				if ( bytes_read == -ECANCELED )
+				{
+					// Resume from this buffer in the next chain
+					break;
+				}
+
+				if ( static_cast< std::size_t >( bytes_read ) != lengths[idx] )
+				{
+					std::cerr << "Failed to read from the local file.";
+					return -1;
+				}
+
+				if ( static_cast< std::size_t >( bytes_sent ) == lengths[idx] )
+				{
+					offset += bytes_read;
+					continue;
+				}
+
+				if ( ( bytes_sent < 0 ) && ( bytes_sent != -EINTR ) && ( bytes_sent != -EAGAIN ) )
+				{
+					std::cerr << "Failed to send data.";
+					return -1;
+				}
+
+				// A short send broke the chain; complete this buffer synchronously
+				for ( auto sent = std::max( bytes_sent, 0 ); static_cast< std::size_t >( sent ) < lengths[idx]; )
+				{
+					const auto size_sent = sink.send_message( static_cast< void* >( uring.buffer( idx ) + sent ), lengths[idx] - sent );
+
+					if ( size_sent <= 0 )
+					{
+						return -1;
+					}
+
+					sent += size_sent;
+				}
+
+				// Kernels that keep the chain going would have sent later buffers out of order
+				for ( auto next = idx + 1; next < count; ++next )
+				{
+					if ( results[2 * next + 1] != -ECANCELED )
+					{
+						std::cerr << "Failed to send data in order.";
+						return -1;
+					}
+				}
+
+				offset += bytes_read;
+				break;
+			}
+		}
+
+		if ( ::lseek( file_handle, offset, SEEK_SET ) == -1 )
+		{
+			return -1;
+		}
+
+		return offset - start;
+	#else
+		static_cast< void >( file_handle );
+		static_cast< void >( sink );
+
+		return -1;
+	#endif
+	}
+}
@@ -0,0 +1,106 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "catch.hpp"
+#include "command_encoder.hpp"
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+
+using networking::command_encoder;
+using networking::ftp_verb;
+
+// Allocations made by the process, counted by the replaced operator new
+static std::size_t allocation_count = 0;
+
+void*
+operator new( std::size_t size )
+{
+	++allocation_count;
+
+	if ( auto* memory = std::malloc( ( size > 0 ) ? size : 1 ) )
+	{
+		return memory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void
+operator delete( void* memory ) noexcept
+{
+	std::free( memory );
+}
+
+void
+operator delete(
+	void* memory,
+	std::size_t ) noexcept
+{
+	std::free( memory );
+}
+
+TEST_CASE( "Command lines are written verb, argument and line ending", "[command_encoder]" )
+{
+	command_encoder encoder;
+
+	REQUIRE( encoder.append( ftp_verb::USER, "anonymous" ) );
+	REQUIRE( encoder.append( ftp_verb::PASV ) );
+	REQUIRE( encoder.append( "OPTS", "UTF8 ON" ) );
+
+	REQUIRE( std::string( encoder.data(), encoder.size() ) == "USER anonymous\r\nPASV\r\nOPTS UTF8 ON\r\n" );
+
+	encoder.clear();
+
+	REQUIRE( encoder.empty() );
+}
+
+TEST_CASE( "Line endings and oversized lines are refused", "[command_encoder]" )
+{
+	command_encoder encoder;
+
+	REQUIRE( encoder.append( ftp_verb::NOOP ) );
+
+	REQUIRE( !encoder.append( ftp_verb::RETR, "file\r\nDELE file" ) );
+	REQUIRE( !encoder.append( "NO\nOP" ) );
+	REQUIRE( !encoder.append( "" ) );
+	REQUIRE( !encoder.append( ftp_verb::STOR, std::string( command_encoder::CAPACITY, 'x' ) ) );
+
+	// The buffer is left as it was
+	REQUIRE( std::string( encoder.data(), encoder.size() ) == "NOOP\r\n" );
+}
+
+TEST_CASE( "Encoding allocates nothing", "[command_encoder]" )
+{
+	const auto allocations_at_start = allocation_count;
+
+	std::unique_ptr< command_encoder > encoder( new command_encoder() );
+	const std::string path( 4 * 1024, 'p' );
+
+	// The replaced operator new is the one in use
+	REQUIRE( allocation_count > allocations_at_start );
+
+	const auto allocations_before = allocation_count;
+
+	bool appended = true;
+
+	for ( auto idx = 0; idx < 1000; ++idx )
+	{
+		encoder->clear();
+
+		appended = encoder->append( ftp_verb::TYPE, "I" ) &&
+			encoder->append( ftp_verb::RETR, path ) &&
+			encoder->append( "SITE", "CHMOD 644 file" ) &&
+			!encoder->append( ftp_verb::CWD, "dir\r\n" ) &&
+			appended;
+	}
+
+	const auto allocations = allocation_count - allocations_before;
+
+	REQUIRE( appended );
+	REQUIRE( allocations == 0 );
+}
@@ -0,0 +1,8 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
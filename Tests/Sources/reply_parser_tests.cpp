@@ -0,0 +1,106 @@
+/**
+ * Daniel Sebastian Iliescu, http://dansil.net
+ * MIT License (MIT), http://opensource.org/licenses/MIT
+ */
+
+#include "catch.hpp"
+#include "reply_parser.hpp"
+
+#include <algorithm>
+#include <string>
+
+using networking::reply_parser;
+using networking::reply_view;
+
+// Receives the bytes into the parser, as many segments as the buffer needs
+static void
+receive(
+	reply_parser& parser,
+	std::string const & bytes )
+{
+	for ( std::size_t offset = 0; offset < bytes.size(); )
+	{
+		std::size_t size = 0;
+		auto* buffer = parser.prepare( size );
+
+		REQUIRE( size > 0 );
+		REQUIRE( size <= reply_parser::CAPACITY );
+
+		const auto count = std::min( size, bytes.size() - offset );
+
+		std::copy( bytes.begin() + offset, bytes.begin() + offset + count, buffer );
+		parser.commit( count );
+
+		offset += count;
+	}
+}
+
+TEST_CASE( "Replies split across segments are parsed whole", "[reply_parser]" )
+{
+	reply_parser parser;
+	reply_view reply;
+
+	receive( parser, "220-Welcome\r\n22" );
+	REQUIRE( !parser.next( reply ) );
+
+	receive( parser, "0 Ready\r\n331 Password\r\n" );
+	REQUIRE( parser.next( reply ) );
+	REQUIRE( reply.code == 220 );
+	REQUIRE( reply.text == "220-Welcome\r\n220 Ready\r\n" );
+
+	REQUIRE( parser.next( reply ) );
+	REQUIRE( reply.code == 331 );
+	REQUIRE( !parser.next( reply ) );
+	REQUIRE( !parser.has_pending() );
+}
+
+TEST_CASE( "A first line filling the buffer leaves room for the next line", "[reply_parser]" )
+{
+	reply_parser parser;
+	reply_view reply;
+
+	// The line in progress starts two bytes before the end of the buffer
+	const auto first_line = "122-" + std::string( reply_parser::CAPACITY - 8, 'x' ) + "\r\n";
+
+	REQUIRE( first_line.size() == reply_parser::CAPACITY - 2 );
+
+	receive( parser, first_line );
+	REQUIRE( !parser.next( reply ) );
+
+	receive( parser, "12" );
+	REQUIRE( !parser.next( reply ) );
+
+	receive( parser, "2 Done\r\n" );
+	REQUIRE( parser.next( reply ) );
+	REQUIRE( reply.code == 122 );
+	REQUIRE( reply.text.size() < reply_parser::CAPACITY );
+	REQUIRE( reply.text.substr( 0, 4 ) == "122-" );
+
+	auto line = reply.lines().begin();
+	REQUIRE( line->substr( 0, 4 ) == "122-" );
+	REQUIRE( *++line == "122 Done" );
+	REQUIRE( ++line == reply.lines().end() );
+}
+
+TEST_CASE( "A reply longer than the buffer keeps its first and last lines", "[reply_parser]" )
+{
+	reply_parser parser;
+	reply_view reply;
+
+	receive( parser, "211-Features:\r\n" );
+
+	// Each segment is scanned as it arrives, as on a connection
+	for ( auto idx = 0; idx < 2000; ++idx )
+	{
+		REQUIRE( !parser.next( reply ) );
+
+		receive( parser, " FEAT" + std::to_string( idx ) + "\r\n" );
+	}
+
+	receive( parser, "211 End\r\n" );
+
+	REQUIRE( parser.next( reply ) );
+	REQUIRE( reply.code == 211 );
+	REQUIRE( *reply.lines().begin() == "211-Features:" );
+	REQUIRE( reply.text.substr( reply.text.size() - 9 ) == "211 End\r\n" );
+}